@@ -37,6 +37,9 @@ int main(int argc, char **argv) {
          "Directory or path of output snake files");
 
     soax::DataContainer ridge_range, stretch_range;
+    double tile_size = 0.0;
+    unsigned num_threads = 0;
+    double length_bin = 0.0;
     po::options_description optional("Optional options");
     optional.add_options()
         ("ridge",
@@ -45,7 +48,21 @@ int main(int argc, char **argv) {
         ("stretch",
          po::value<soax::DataContainer>(&stretch_range)->multitoken(),
          "Range of stretching factor (start step end)")
-        ("invert", "Use inverted image intensity");
+        ("invert", "Use inverted image intensity")
+        ("tile", po::value<double>(&tile_size),
+         "Deform snakes in parallel in tiles of this size (pixels)")
+        ("optimistic",
+         "Deform snakes in parallel rounds validated on commit")
+        ("deterministic",
+         "Deform snakes in parallel with the results of the serial order")
+        ("concurrent",
+         "Deform snakes in parallel without rounds (results depend on "
+         "thread timing)")
+        ("threads", po::value<unsigned>(&num_threads),
+         "Number of threads for parallel deformation (0 for all)")
+        ("length-bin", po::value<double>(&length_bin),
+         "Order initial snakes of similar length by location, "
+         "with length bins of this width");
 
     po::options_description all("Allowed options");
     all.add(generic).add(required).add(optional);
@@ -91,6 +108,20 @@ int main(int argc, char **argv) {
 
     try {
       soax::Multisnake *multisnake = new soax::Multisnake;
+      soax::Multisnake::DeformationScheme scheme =
+          soax::Multisnake::kSerialDeformation;
+      if (vm.count("tile")) {
+        scheme = soax::Multisnake::kTiledDeformation;
+        multisnake->set_tile_size(tile_size);
+      } else if (vm.count("optimistic")) {
+        scheme = soax::Multisnake::kOptimisticDeformation;
+      } else if (vm.count("deterministic")) {
+        scheme = soax::Multisnake::kDeterministicDeformation;
+      } else if (vm.count("concurrent")) {
+        scheme = soax::Multisnake::kConcurrentDeformation;
+      }
+      multisnake->set_number_of_threads(num_threads);
+      multisnake->set_length_bin(length_bin);
       if (vm.count("ridge") && vm.count("stretch")) {
         std::cout << "Varying ridge threshold and stretch factor."
                   << std::endl;
@@ -122,7 +153,10 @@ int main(int argc, char **argv) {
                           << std::endl;
               } else {
                 std::cout << "stretch is set to: " << stretch << std::endl;
-                soax::Snake::set_stretch_factor(stretch);
+                soax::SnakeParameters parameters =
+                    multisnake->snake_parameters();
+                parameters.set_stretch_factor(stretch);
+                multisnake->set_snake_parameters(parameters);
 
                 std::cout << "=========== Current Parameters ==========="
                           << std::endl;
@@ -134,7 +168,7 @@ int main(int argc, char **argv) {
 
                 time_t start, end;
                 time(&start);
-                multisnake->DeformSnakes();
+                multisnake->DeformSnakes(scheme);
                 time(&end);
                 double time_elasped = difftime(end, start);
                 multisnake->CutSnakesAtTJunctions();
@@ -182,7 +216,10 @@ int main(int argc, char **argv) {
               double stretch = stretch_range[0];
               while (stretch < stretch_range[2]) {
                 std::cout << "stretch is set to: " << stretch << std::endl;
-                soax::Snake::set_stretch_factor(stretch);
+                soax::SnakeParameters parameters =
+                    multisnake->snake_parameters();
+                parameters.set_stretch_factor(stretch);
+                multisnake->set_snake_parameters(parameters);
 
                 std::cout << "=========== Current Parameters ==========="
                           << std::endl;
@@ -194,7 +231,7 @@ int main(int argc, char **argv) {
 
                 time_t start, end;
                 time(&start);
-                multisnake->DeformSnakes();
+                multisnake->DeformSnakes(scheme);
                 time(&end);
                 double time_elasped = difftime(end, start);
 
@@ -257,7 +294,7 @@ int main(int argc, char **argv) {
 
             time_t start, end;
             time(&start);
-            multisnake->DeformSnakes();
+            multisnake->DeformSnakes(scheme);
             time(&end);
             double time_elasped = difftime(end, start);
 
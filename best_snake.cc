@@ -99,7 +99,9 @@ int main(int argc, char **argv) {
         ("ground-truth,g", po::value<std::string>(),
          "Path of the ground truth snake")
         ("error,e", po::value<std::string>(),
-         "Path of the output 'tc-candidate-error' file");
+         "Path of the output 'tc-candidate-error' file")
+        ("threads", po::value<unsigned>()->default_value(0),
+         "Number of threads for error evaluation (0 for all)");
 
     po::options_description all("Allowed options");
     all.add(generic).add(required).add(optional);
@@ -131,6 +133,7 @@ int main(int argc, char **argv) {
       fs::path snake_dir(vm["snake"].as<std::string>());
       if (fs::exists(snake_dir)) {
         soax::Multisnake ms;
+        ms.set_number_of_threads(vm["threads"].as<unsigned>());
         ms.LoadImage(vm["image"].as<std::string>());
         Paths snake_paths;
         CreateSortedSnakePaths(snake_dir, snake_paths);
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file implements the shared cache of snake system factorizations
+ * for SOAX.
+ */
+
+#include "./factorization_cache.h"
+
+namespace soax {
+
+const std::size_t FactorizationCache::kDefaultCapacity;
+
+bool FactorizationCache::Key::operator<(const Key &k) const {
+  if (order != k.order) return order < k.order;
+  if (open != k.open) return open < k.open;
+  if (alpha != k.alpha) return alpha < k.alpha;
+  if (beta != k.beta) return beta < k.beta;
+  return gamma < k.gamma;
+}
+
+FactorizationCache::FactorizationCache(std::size_t capacity) :
+    capacity_(capacity), size_(0) {}
+
+FactorizationCache::SolverPointer FactorizationCache::GetSolver(
+    unsigned order, bool open, double alpha, double beta, double gamma) {
+  Key key = {order, open, alpha, beta, gamma};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EntryMap::iterator it = index_.find(key);
+    if (it != index_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->second;
+    }
+  }
+
+  // Factor outside of the lock so that other threads are not blocked.
+  SolverPointer solver(new PentadiagonalSolver(order, open, alpha, beta,
+                                               gamma));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  EntryMap::iterator it = index_.find(key);
+  if (it != index_.end()) {
+    // Another thread has inserted the same system meanwhile.
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+  entries_.push_front(std::make_pair(key, solver));
+  index_[key] = entries_.begin();
+  size_ += solver->GetMemorySize();
+  this->Shrink();
+  return solver;
+}
+
+void FactorizationCache::Shrink() {
+  while (size_ > capacity_ && !entries_.empty()) {
+    size_ -= entries_.back().second->GetMemorySize();
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+}
+
+std::size_t FactorizationCache::capacity() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return capacity_;
+}
+
+void FactorizationCache::set_capacity(std::size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = bytes;
+  this->Shrink();
+}
+
+std::size_t FactorizationCache::GetMemorySize() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+unsigned FactorizationCache::GetNumberOfSolvers() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+void FactorizationCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  index_.clear();
+  size_ = 0;
+}
+
+FactorizationCache *FactorizationCache::GetSharedCache() {
+  static FactorizationCache cache;
+  return &cache;
+}
+
+}  // namespace soax
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file defines the shared cache of snake system factorizations for
+ * SOAX.
+ */
+
+
+#ifndef FACTORIZATION_CACHE_H_
+#define FACTORIZATION_CACHE_H_
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "./global.h"
+#include "./pentadiagonal_solver.h"
+
+namespace soax {
+
+/*
+ * A cache of immutable factorized solvers keyed by (order, open, alpha,
+ * beta, gamma). It can be shared by the solver banks of several threads:
+ * lookups are serialized by a mutex, but the returned solvers are const
+ * and can be used concurrently without locking. The total memory of the
+ * cached factorizations is kept under a byte budget by evicting the
+ * least recently used ones. An evicted solver stays valid for as long as
+ * someone holds it.
+ */
+class FactorizationCache {
+ public:
+  typedef std::shared_ptr<const PentadiagonalSolver> SolverPointer;
+
+  explicit FactorizationCache(std::size_t capacity = kDefaultCapacity);
+
+  /*
+   * Return the solver for the given system, factoring it on a miss.
+   */
+  SolverPointer GetSolver(unsigned order, bool open, double alpha,
+                          double beta, double gamma);
+
+  /*
+   * Byte budget of the cache. Shrinking it evicts immediately.
+   */
+  std::size_t capacity() const;
+  void set_capacity(std::size_t bytes);
+
+  /*
+   * Bytes used by the cached factorizations.
+   */
+  std::size_t GetMemorySize() const;
+
+  unsigned GetNumberOfSolvers() const;
+
+  void Clear();
+
+  /*
+   * The process-wide cache used by solver banks by default.
+   */
+  static FactorizationCache *GetSharedCache();
+
+  static const std::size_t kDefaultCapacity = 64 * 1024 * 1024;
+
+ private:
+  struct Key {
+    unsigned order;
+    bool open;
+    double alpha;
+    double beta;
+    double gamma;
+
+    bool operator<(const Key &k) const;
+  };
+
+  typedef std::list<std::pair<Key, SolverPointer> > EntryList;
+  typedef std::map<Key, EntryList::iterator> EntryMap;
+
+  /*
+   * Evict the least recently used solvers until the budget is met. The
+   * caller must hold mutex_.
+   */
+  void Shrink();
+
+  /*
+   * Most recently used solvers are at the front.
+   */
+  EntryList entries_;
+  EntryMap index_;
+  std::size_t capacity_;
+  std::size_t size_;
+  mutable std::mutex mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(FactorizationCache);
+};
+
+}  // namespace soax
+
+#endif  // FACTORIZATION_CACHE_H_
@@ -7,10 +7,12 @@
  */
 
 #include <cassert>
+#include <cmath>
 #include <fstream>
 #include <algorithm>
 #include "./junctions.h"
 #include "./snake.h"
+#include "./snake_index.h"
 
 namespace soax {
 Junctions::Junctions() {}
@@ -36,6 +38,7 @@ void Junctions::DeleteTipContainer() {
     delete *it;
   }
   tips_.clear();
+  head_indices_.clear();
 }
 
 void Junctions::Reset() {
@@ -48,6 +51,7 @@ void Junctions::Initialize(const SnakeContainer &seg) {
   for (SnakeConstIterator it = seg.begin(); it != seg.end(); ++it) {
     SnakeTip * head = new SnakeTip(*it, true);
     SnakeTip * tail = new SnakeTip(*it, false);
+    head_indices_.insert(std::make_pair(*it, tips_.size()));
 
     tips_.push_back(head);
     tips_.push_back(tail);
@@ -57,10 +61,7 @@ void Junctions::Initialize(const SnakeContainer &seg) {
 void Junctions::Union() {
   assert(!tips_.empty());
 
-  for (TipContainer::iterator it = tips_.begin();
-       it != tips_.end(); ++it) {
-    this->AddToTipSets(*it);
-  }
+  this->ClusterTips();
   // Get rid of both tips included in a snaketipset
   TipContainer singleton_tips;
   for (TipSetContainer::iterator it = tip_sets_.begin();
@@ -81,68 +82,108 @@ void Junctions::Union() {
   }
 }
 
-void Junctions::AddToTipSets(SnakeTip *t) {
-  TipSetContainer close_tip_sets;
-  // Find any TipSets that is close to t and put them to close_tip_sets
-  this->FindCloseTipSets(t, close_tip_sets);
-  // Get consolidated TipSet by merging TipSets which are all close to t
-  SnakeTipSet *ts = this->MergeCloseTipSets(close_tip_sets);
-  // Add t to the consolidated TipSet
-  this->JoinTipSet(t, ts);
-}
-
-void Junctions::FindCloseTipSets(SnakeTip *t,
-                                 TipSetContainer &close_tip_sets) const {
-  if (tip_sets_.empty()) return;
+/*
+ * Implementation Notes: ClusterTips:
+ * ----------------------------------
+ * Tips closer than the grouping distance threshold belong to the same tip
+ * set, transitively. The tips are added in the order of tips_. The tips
+ * close to a new one are found in a hash grid of the tips added so far,
+ * and their sets are merged with union-find. This takes near-linear time.
+ *
+ * The result matches adding the tips one at a time to a list of tip sets,
+ * merging every set close to the new tip into the earliest one. So the
+ * sets are ordered by their first tip. A merged set lists the tips of the
+ * sets it merges in that order, then the new tip. The tips of a set are
+ * chained in next, and each root keeps the first and last tip of its set.
+ */
+void Junctions::ClusterTips() {
+  const unsigned size = tips_.size();
+  const double threshold =
+      tips_.front()->snake()->parameters().grouping_distance_threshold();
+  const double cell_size = threshold > 0.0 ? threshold : 1.0;
+  std::vector<unsigned> parent(size), rank(size, 0), next(size, size);
+  std::vector<unsigned> first(size), last(size);
+  std::unordered_map<uint64_t, std::vector<unsigned> > cells;
+  std::vector<unsigned> roots;
+
+  for (unsigned t = 0; t < size; ++t) {
+    const PointType p = tips_[t]->tip();
+    int64_t low[kDimension], high[kDimension];
+    for (unsigned k = 0; k < kDimension; ++k) {
+      low[k] = std::floor((p[k] - threshold) / cell_size);
+      high[k] = std::floor((p[k] + threshold) / cell_size);
+    }
 
-  for (TipSetContainer::const_iterator it = tip_sets_.begin();
-       it != tip_sets_.end(); ++it) {
-    double dist = (*it)->ComputeDistance(t);
-    if (dist < Snake::grouping_distance_threshold()) {
-      close_tip_sets.push_back(*it);
+    roots.clear();
+    for (int64_t i = low[0]; i <= high[0]; ++i) {
+      for (int64_t j = low[1]; j <= high[1]; ++j) {
+        for (int64_t k = low[2]; k <= high[2]; ++k) {
+          std::unordered_map<uint64_t, std::vector<unsigned> >::const_iterator
+              it = cells.find(SnakeIndex::ComputeKey(i, j, k));
+          if (it == cells.end()) continue;
+          for (std::vector<unsigned>::const_iterator u = it->second.begin();
+               u != it->second.end(); ++u) {
+            if (tips_[t]->DistanceTo(tips_[*u]) < threshold)
+              roots.push_back(FindRoot(parent, *u));
+          }
+        }
+      }
     }
-  }
-}
 
-SnakeTipSet * Junctions::MergeCloseTipSets(
-    const TipSetContainer &close_tip_sets) {
-  if (close_tip_sets.empty()) {
-    return NULL;
-  } else if (close_tip_sets.size() == 1) {
-    return close_tip_sets.front();
-  } else {
-    SnakeTipSet *ts = close_tip_sets.front();
-    for (TipSetContainer::const_iterator it = close_tip_sets.begin()+1;
-         it != close_tip_sets.end(); ++it) {
-      ts->Combine(*it);
-      this->RemoveTipSet(*it);
+    parent[t] = t;
+    first[t] = last[t] = t;
+    if (!roots.empty()) {
+      // Order the close sets by their first tip, and chain their tips.
+      for (unsigned n = 0; n < roots.size(); ++n)
+        roots[n] = first[roots[n]];
+      std::sort(roots.begin(), roots.end());
+      roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+      unsigned root = FindRoot(parent, roots.front());
+      const unsigned head = first[root];
+      for (unsigned n = 1; n < roots.size(); ++n) {
+        const unsigned r = FindRoot(parent, roots[n]);
+        next[last[root]] = first[r];
+        const unsigned tail = last[r];
+        root = LinkRoots(parent, rank, root, r);
+        first[root] = head;
+        last[root] = tail;
+      }
+      next[last[root]] = t;
+      const unsigned merged = LinkRoots(parent, rank, root, t);
+      first[merged] = head;
+      last[merged] = t;
     }
 
-    return ts;
+    cells[SnakeIndex::ComputeKey(std::floor(p[0] / cell_size),
+                                 std::floor(p[1] / cell_size),
+                                 std::floor(p[2] / cell_size))].push_back(t);
   }
-}
-
 
-void Junctions::RemoveTipSet(SnakeTipSet *ts) {
-  TipSetContainer::iterator it = std::find(tip_sets_.begin(),
-                                           tip_sets_.end(),
-                                           ts);
-  if (it != tip_sets_.end()) {
-    delete *it;
-    tip_sets_.erase(it);
-  } else {
-    std::cerr << "Junctions::RemoveTipSet: ts not found!" << std::endl;
+  for (unsigned t = 0; t < size; ++t) {
+    if (first[FindRoot(parent, t)] != t) continue;
+    SnakeTipSet *ts = new SnakeTipSet(tips_[t]);
+    for (unsigned u = next[t]; u != size; u = next[u])
+      ts->Add(tips_[u]);
+    tip_sets_.push_back(ts);
   }
 }
 
-
-void Junctions::JoinTipSet(SnakeTip *t, SnakeTipSet *ts) {
-  if (!ts)
-    this->AddNewTipSet(t);
-  else
-    ts->Add(t);
+unsigned Junctions::FindRoot(std::vector<unsigned> &parent, unsigned i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
 }
 
+unsigned Junctions::LinkRoots(std::vector<unsigned> &parent,
+                              std::vector<unsigned> &rank,
+                              unsigned a, unsigned b) {
+  if (rank[a] < rank[b]) std::swap(a, b);
+  parent[b] = a;
+  if (rank[a] == rank[b]) rank[a]++;
+  return a;
+}
 
 void Junctions::AddNewTipSet(SnakeTip *t) {
   SnakeTipSet *ts = new SnakeTipSet(t);
@@ -191,12 +232,10 @@ void Junctions::PrintTipSets() const {
 }
 
 SnakeTip * Junctions::FindSnakeTip(Snake *s, bool is_head) const {
-  for (TipContainer::const_iterator it = tips_.begin();
-       it != tips_.end(); ++it) {
-    if ((*it)->snake() == s && (*it)->is_head() == is_head)
-      return *it;
-  }
-  return NULL;
+  std::unordered_map<const Snake *, unsigned>::const_iterator it =
+      head_indices_.find(s);
+  if (it == head_indices_.end()) return NULL;
+  return tips_[is_head ? it->second : it->second + 1];
 }
 
 void Junctions::PrintJunctionPoints(const std::string &filename) const {
@@ -10,6 +10,7 @@
 #define JUNCTIONS_H_
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "./global.h"
 #include "./snake_tip_set.h"
@@ -60,14 +61,21 @@ class Junctions {
 
   void DeleteTipSetContainer();
   void DeleteTipContainer();
-  void AddToTipSets(SnakeTip *t);
 
-  void FindCloseTipSets(SnakeTip *t, TipSetContainer &close_tip_sets) const;
-
-  SnakeTipSet * MergeCloseTipSets(const TipSetContainer &close_tip_sets);
+  /*
+   * Group the tips into tip_sets_, so that tips closer than the grouping
+   * distance threshold are in the same set.
+   */
+  void ClusterTips();
 
-  void RemoveTipSet(SnakeTipSet *ts);
-  void JoinTipSet(SnakeTip *t, SnakeTipSet *ts);
+  /*
+   * Union-find over tip indices, with path halving and union by rank.
+   * LinkRoots returns the root of the union.
+   */
+  static unsigned FindRoot(std::vector<unsigned> &parent, unsigned i);
+  static unsigned LinkRoots(std::vector<unsigned> &parent,
+                            std::vector<unsigned> &rank,
+                            unsigned a, unsigned b);
 
   void AddNewTipSet(SnakeTip *t);
 
@@ -83,6 +91,12 @@ class Junctions {
 
   TipSetContainer tip_sets_;
   TipContainer tips_;
+
+  /*
+   * Position of the head tip of each snake in tips_. The tail tip
+   * follows it.
+   */
+  std::unordered_map<const Snake *, unsigned> head_indices_;
   PointContainer junction_points_;
 
   DISALLOW_COPY_AND_ASSIGN(Junctions);
@@ -806,12 +806,20 @@ void MainWindow::EditSnake() {
   if (toggle_delete_snake_->isChecked()) {
     multisnake_->DeleteSnakes(viewer_->selected_snakes());
     viewer_->RemoveSelectedSnakes();
+    if (multisnake_->ValidateJunctions()) {
+      viewer_->RemoveJunctions();
+      viewer_->SetupJunctions(multisnake_->GetJunctions());
+      viewer_->ToggleJunctions(toggle_junctions_->isChecked());
+    }
   } else if (toggle_trim_tip_->isChecked()) {
     viewer_->TrimTip();
+    multisnake_->InvalidateJunctionIndex();
   } else if (toggle_extend_tip_->isChecked()) {
     viewer_->ExtendTip();
+    multisnake_->InvalidateJunctionIndex();
   } else if (toggle_trim_body_->isChecked()) {
     viewer_->TrimBody();
+    multisnake_->InvalidateJunctionIndex();
   } else if (toggle_delete_junction_->isChecked()) {
     viewer_->RemoveSelectedJunctions(multisnake_->junctions());
   }
@@ -919,13 +927,15 @@ void MainWindow::DeformSnakes() {
 void MainWindow::DeformSnakesInAction() {
   viewer_->RemoveSnakes();
   progress_bar_->setMaximum(multisnake_->GetNumberOfInitialSnakes());
+  multisnake_->IndexConvergedSnakes();
   unsigned ncompleted = 0;
   while (!multisnake_->initial_snakes().empty()) {
     Snake *s = multisnake_->PopLastInitialSnake();
     viewer_->SetupSnake(s, 0);
     viewer_->Render();
-    s->Evolve(multisnake_->solver_bank(), multisnake_->converged_snakes(),
-              Snake::iterations_per_press(), multisnake_->dim());
+    s->Evolve(multisnake_->solver_bank(), multisnake_->converged_index(),
+              multisnake_->snake_parameters().iterations_per_press(),
+              multisnake_->dim());
 
     if (s->viable()) {
       if (s->converged()) {
@@ -987,8 +997,10 @@ void MainWindow::DeformOneSnake() {
     }
 
     viewer_->trimmed_snake()->EvolveWithTipFixed(
-        multisnake_->solver_bank(), Snake::iterations_per_press(),
+        multisnake_->solver_bank(),
+        multisnake_->snake_parameters().iterations_per_press(),
         multisnake_->dim());
+    multisnake_->InvalidateJunctionIndex();
 
     if (viewer_->trimmed_snake()->converged()) {
       statusBar()->showMessage(tr("Snake is converged."));
@@ -1322,38 +1334,42 @@ void MainWindow::ShowParametersDialog() {
 }
 
 void MainWindow::SetParameters() {
+  SnakeParameters parameters = multisnake_->snake_parameters();
   multisnake_->set_intensity_scaling(
       parameters_dialog_->GetIntensityScaling());
-  Snake::set_intensity_scaling(multisnake_->intensity_scaling());
+  parameters.set_intensity_scaling(multisnake_->intensity_scaling());
   multisnake_->set_sigma(parameters_dialog_->GetSigma());
   multisnake_->set_ridge_threshold(parameters_dialog_->GetRidgeThreshold());
   multisnake_->set_foreground(parameters_dialog_->GetForeground());
   multisnake_->set_background(parameters_dialog_->GetBackground());
-  Snake::set_background(multisnake_->background());
-  Snake::set_desired_spacing(parameters_dialog_->GetSpacing());
+  parameters.set_background(multisnake_->background());
+  parameters.set_desired_spacing(parameters_dialog_->GetSpacing());
   multisnake_->set_initialize_z(parameters_dialog_->InitializeZ());
-  Snake::set_minimum_length(parameters_dialog_->GetMinSnakeLength());
-  Snake::set_max_iterations(parameters_dialog_->GetMaxIterations());
-  Snake::set_change_threshold(parameters_dialog_->GetChangeThreshold());
-  Snake::set_check_period(parameters_dialog_->GetCheckPeriod());
-  Snake::set_iterations_per_press(
+  parameters.set_minimum_length(parameters_dialog_->GetMinSnakeLength());
+  parameters.set_max_iterations(parameters_dialog_->GetMaxIterations());
+  parameters.set_change_threshold(parameters_dialog_->GetChangeThreshold());
+  parameters.set_check_period(parameters_dialog_->GetCheckPeriod());
+  parameters.set_iterations_per_press(
       parameters_dialog_->GetIterationsPerPress());
   multisnake_->solver_bank()->set_alpha(parameters_dialog_->GetAlpha());
   multisnake_->solver_bank()->set_beta(parameters_dialog_->GetBeta());
   multisnake_->solver_bank()->set_gamma(parameters_dialog_->GetGamma());
-  Snake::set_external_factor(parameters_dialog_->GetExternalFactor());
-  Snake::set_stretch_factor(parameters_dialog_->GetStretchFactor());
-  Snake::set_number_of_sectors(parameters_dialog_->GetNumberOfSectors());
-  Snake::set_radial_near(parameters_dialog_->GetRadialNear());
-  Snake::set_radial_far(parameters_dialog_->GetRadialFar());
-  Snake::set_z_spacing(parameters_dialog_->GetZSpacing());
-  Snake::set_delta(parameters_dialog_->GetDelta());
-  Snake::set_overlap_threshold(parameters_dialog_->GetOverlapThreshold());
-  Snake::set_grouping_distance_threshold(
+  parameters.set_external_factor(parameters_dialog_->GetExternalFactor());
+  parameters.set_stretch_factor(parameters_dialog_->GetStretchFactor());
+  parameters.set_number_of_sectors(parameters_dialog_->GetNumberOfSectors());
+  parameters.set_radial_near(parameters_dialog_->GetRadialNear());
+  parameters.set_radial_far(parameters_dialog_->GetRadialFar());
+  parameters.set_z_spacing(parameters_dialog_->GetZSpacing());
+  parameters.set_delta(parameters_dialog_->GetDelta());
+  parameters.set_overlap_threshold(parameters_dialog_->GetOverlapThreshold());
+  parameters.set_grouping_distance_threshold(
       parameters_dialog_->GetGroupingDistanceThreshold());
-  Snake::set_grouping_delta(parameters_dialog_->GetGroupingDelta());
-  Snake::set_direction_threshold(parameters_dialog_->GetDirectionThreshold());
-  Snake::set_damp_z(parameters_dialog_->DampZ());
+  parameters.set_grouping_delta(parameters_dialog_->GetGroupingDelta());
+  parameters.set_direction_threshold(
+      parameters_dialog_->GetDirectionThreshold());
+  parameters.set_damp_z(parameters_dialog_->DampZ());
+  parameters.set_adaptive_step(parameters_dialog_->AdaptiveStep());
+  multisnake_->set_snake_parameters(parameters);
 }
 
 void MainWindow::LoadViewpoint() {
@@ -9,8 +9,16 @@
 
 #include "./multisnake.h"
 #include <QApplication>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
 #include <fstream>
 #include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkBSplineInterpolateImageFunction.h"
@@ -30,16 +38,221 @@
 #include "itkSmoothingRecursiveGaussianImageFilter.h"
 #include "itkExtractImageFilter.h"
 #include "itkTileImageFilter.h"
+#include "./snake_registry.h"
 #include "./solver_bank.h"
 #include "./utility.h"
+#include "./vertex_tree.h"
 
 namespace soax {
 
+namespace {
+
+/*
+ * A cubic part of the volume and the snakes evolved inside it. Tiles
+ * with the same color are at least one tile apart.
+ */
+struct Tile {
+  int64_t cell[kDimension];
+  unsigned color;
+  SnakeContainer snakes;
+  SnakeContainer converged_snakes;
+  SnakeContainer deferred_snakes;
+  unsigned ncompleted;
+};
+
+/*
+ * Compute the cell of the tile containing the bounding box of s grown by
+ * margin, or return false if the box crosses a tile border.
+ */
+bool FindTile(const Snake &s, double tile_size, double margin,
+              int64_t *cell) {
+  PointType low, high;
+  s.GetBounds(low, high);
+  for (unsigned k = 0; k < kDimension; ++k) {
+    cell[k] = static_cast<int64_t>(std::floor((low[k] - margin) / tile_size));
+    if (static_cast<int64_t>(std::floor((high[k] + margin) / tile_size)) !=
+        cell[k])
+      return false;
+  }
+  return true;
+}
+
+bool IsInTile(const Snake &s, const Tile &tile, double tile_size,
+              double margin) {
+  int64_t cell[kDimension];
+  return FindTile(s, tile_size, margin, cell) &&
+      std::equal(cell, cell + kDimension, tile.cell);
+}
+
+/*
+ * Evolve the snakes of tile in the order of the serial loop against the
+ * converged snakes and those converged in the tile. A snake leaving the
+ * tile is started over from its state before the evolution and
+ * deferred, since it may have missed snakes converging outside the tile.
+ */
+void EvolveTile(Tile *tile, const SnakeIndex &converged_index,
+                SolverBank *solver, double tile_size, double margin,
+                unsigned dim) {
+  SnakeIndex index(converged_index.cell_size(), &converged_index);
+  while (!tile->snakes.empty()) {
+    Snake *snake = tile->snakes.back();
+    tile->snakes.pop_back();
+    Snake *start = snake->Clone();
+    solver->Reset(false);
+
+    // Check the tile before every iteration, as each one queries the
+    // converged snakes around the vertices.
+    bool inside = IsInTile(*snake, *tile, tile_size, margin);
+    bool finished = false;
+    while (inside && !finished) {
+      finished = snake->EvolveIterations(solver, index, 0, dim);
+      if (snake->viable())
+        inside = IsInTile(*snake, *tile, tile_size, margin);
+    }
+
+    if (!inside) {
+      delete snake;
+      tile->deferred_snakes.push_back(start);
+      continue;
+    }
+    delete start;
+
+    snake->CheckBodyOverlap(index);
+    if (snake->viable()) {
+      tile->converged_snakes.push_back(snake);
+      index.AddSnake(snake);
+    } else {
+      tile->snakes.insert(tile->snakes.end(), snake->subsnakes().begin(),
+                          snake->subsnakes().end());
+      delete snake;
+    }
+    tile->ncompleted++;
+  }
+}
+
+/*
+ * Interleave the bits of the voxel coordinates of p, 21 bits each, so
+ * that points close in space tend to get close keys.
+ */
+uint64_t ComputeMortonKey(const PointType &p) {
+  const uint64_t mask = (static_cast<uint64_t>(1) << 21) - 1;
+  uint64_t key = 0;
+  for (unsigned k = 0; k < kDimension; ++k) {
+    const uint64_t c = static_cast<uint64_t>(std::max(p[k], 0.0)) & mask;
+    for (unsigned b = 0; b < 21; ++b)
+      key |= ((c >> b) & 1) << (kDimension * b + k);
+  }
+  return key;
+}
+
+/*
+ * An initial snake with its length bin and the Morton key of its
+ * centroid, ordered by bin then key.
+ */
+struct LocalizedSnake {
+  Snake *snake;
+  int64_t bin;
+  uint64_t key;
+
+  bool operator<(const LocalizedSnake &other) const {
+    return bin < other.bin || (bin == other.bin && key < other.key);
+  }
+};
+
+/*
+ * A snake evolved against a snapshot of the converged snakes, with its
+ * state before the evolution and a box holding every point its overlap
+ * queries reached.
+ */
+struct Speculation {
+  Snake *snake;
+  Snake *start;
+  PointType low;
+  PointType high;
+
+  /*
+   * Number of converged snakes when the evolution started.
+   */
+  unsigned snapshot;
+};
+
+void ExtendBounds(const Snake &s, PointType &low, PointType &high) {
+  PointType l, h;
+  s.GetBounds(l, h);
+  for (unsigned k = 0; k < kDimension; ++k) {
+    low[k] = std::min(low[k], l[k]);
+    high[k] = std::max(high[k], h[k]);
+  }
+}
+
+/*
+ * Implementation Notes:
+ *
+ * A speculative evolution is valid if no snake converged after it
+ * started has a vertex in the box its overlap queries reached. The box
+ * is grown from the bounding boxes of the snake by twice the overlap
+ * threshold, as the tiles are in DeformSnakesInTiles. An invalid snake
+ * is started over from its state before the evolution, since a
+ * converged snake would skip the tip overlap handling if evolved again
+ * from its speculative state.
+ */
+bool HasVertexInBox(const Snake &s, const PointType &low,
+                    const PointType &high) {
+  for (unsigned i = 0; i < s.GetSize(); ++i) {
+    const PointType p = s.GetPoint(i);
+    unsigned k = 0;
+    while (k < kDimension && p[k] >= low[k] && p[k] <= high[k])
+      ++k;
+    if (k == kDimension) return true;
+  }
+  return false;
+}
+
+/*
+ * Delete the evolved snake of spec and its subsnakes, and return its
+ * state before the evolution.
+ */
+Snake *DiscardSpeculation(const Speculation &spec) {
+  for (SnakeConstIterator s = spec.snake->subsnakes().begin();
+       s != spec.snake->subsnakes().end(); ++s)
+    delete *s;
+  delete spec.snake;
+  return spec.start;
+}
+
+/*
+ * Evolve the snake of spec against converged_index as the serial loop
+ * would, and record the box its queries reached, which lies within
+ * margin of the bounding boxes of the snake along the way.
+ */
+void EvolveSpeculatively(Speculation *spec, const SnakeIndex &converged_index,
+                         SolverBank *solver, double margin, unsigned dim) {
+  Snake *snake = spec->snake;
+  spec->start = snake->Clone();
+  snake->GetBounds(spec->low, spec->high);
+  solver->Reset(false);
+  bool finished = false;
+  while (!finished) {
+    finished = snake->EvolveIterations(solver, converged_index, 0, dim);
+    if (snake->viable())
+      ExtendBounds(*snake, spec->low, spec->high);
+  }
+  snake->CheckBodyOverlap(converged_index);
+  for (unsigned k = 0; k < kDimension; ++k) {
+    spec->low[k] -= margin;
+    spec->high[k] += margin;
+  }
+}
+
+}  // namespace
+
 Multisnake::Multisnake(QObject *parent) :
     QObject(parent), image_(NULL), external_force_(NULL),
     intensity_scaling_(0.0), sigma_(0.0),
     ridge_threshold_(0.01), foreground_(65535),
-    background_(0), initialize_z_(true), dim_(kDimension) {
+    background_(0), initialize_z_(true), dim_(kDimension),
+    number_of_threads_(0), tile_size_(64.0), number_of_commits_(0),
+    number_of_retries_(0), number_of_evolutions_(0), length_bin_(0.0) {
   interpolator_ = InterpolatorType::New();
   vector_interpolator_ = VectorInterpolatorType::New();
   transform_ = TransformType::New();
@@ -60,6 +273,8 @@ Multisnake::~Multisnake() {
 void Multisnake::Reset() {
   this->ClearSnakeContainer(initial_snakes_);
   this->ClearSnakeContainer(converged_snakes_);
+  converged_index_.Clear();
+  junction_index_.Clear();
   this->ClearSnakeContainer(comparing_snakes1_);
   this->ClearSnakeContainer(comparing_snakes2_);
   junctions_.Reset();
@@ -72,6 +287,8 @@ void Multisnake::Reset() {
 void Multisnake::ResetContainers() {
   this->ClearSnakeContainer(initial_snakes_);
   this->ClearSnakeContainer(converged_snakes_);
+  converged_index_.Clear();
+  junction_index_.Clear();
   junctions_.Reset();
   solver_bank_->Reset(false);
 }
@@ -102,6 +319,16 @@ void Multisnake::LoadImage(const std::string &filename) {
   this->set_intensity_scaling(intensity_scaling_);
 }
 
+void Multisnake::ShareImage(const Multisnake &source) {
+  image_filename_ = source.image_filename_;
+  image_ = source.image_;
+  external_force_ = source.external_force_;
+  dim_ = source.dim_;
+  interpolator_->SetInputImage(image_);
+  if (external_force_)
+    vector_interpolator_->SetInputImage(external_force_);
+}
+
 std::string Multisnake::GetImageName(bool suffix) const {
   unsigned last_slash_pos = image_filename_.find_last_of("/\\");
   if (!suffix) {
@@ -207,29 +434,29 @@ void Multisnake::AssignParameters(const std::string &name,
                                   const std::string &value) {
   if (name == "intensity-scaling") {
     this->set_intensity_scaling(String2Double(value));
-    Snake::set_intensity_scaling(intensity_scaling_);
+    snake_parameters_.set_intensity_scaling(intensity_scaling_);
   } else if (name == "smoothing" || name == "gaussian-std") {
     sigma_ = String2Double(value);
   } else if (name == "grad-diff" || name == "ridge-threshold") {
     ridge_threshold_ = String2Double(value);
   } else if (name == "foreground" || name == "maximum-foreground") {
     foreground_ = String2Unsigned(value);
-    Snake::set_foreground(foreground_);
+    snake_parameters_.set_foreground(foreground_);
   } else if (name == "background" || name == "minimum-foreground") {
     background_ = String2Unsigned(value);
-    Snake::set_background(background_);
+    snake_parameters_.set_background(background_);
   } else if (name == "spacing" || name == "snake-point-spacing") {
-    Snake::set_desired_spacing(String2Double(value));
+    snake_parameters_.set_desired_spacing(String2Double(value));
   } else if (name == "init-z") {
     initialize_z_ = value == "true";
   } else if (name == "minimum-size" || name == "minimum-snake-length") {
-    Snake::set_minimum_length(String2Double(value));
+    snake_parameters_.set_minimum_length(String2Double(value));
   } else if (name == "max-iterations" || name == "maximum-iterations") {
-    Snake::set_max_iterations(String2Unsigned(value));
+    snake_parameters_.set_max_iterations(String2Unsigned(value));
   } else if (name == "change-threshold") {
-    Snake::set_change_threshold(String2Double(value));
+    snake_parameters_.set_change_threshold(String2Double(value));
   } else if (name == "check-period") {
-    Snake::set_check_period(String2Unsigned(value));
+    snake_parameters_.set_check_period(String2Unsigned(value));
   } else if (name == "alpha") {
     solver_bank_->set_alpha(String2Double(value));
   } else if (name == "beta") {
@@ -237,31 +464,33 @@ void Multisnake::AssignParameters(const std::string &name,
   } else if (name == "gamma") {
     solver_bank_->set_gamma(String2Double(value));
   } else if (name == "weight" || name == "external-factor") {
-    Snake::set_external_factor(String2Double(value));
+    snake_parameters_.set_external_factor(String2Double(value));
   } else if (name == "stretch" || name == "stretch-factor") {
-    Snake::set_stretch_factor(String2Double(value));
+    snake_parameters_.set_stretch_factor(String2Double(value));
   } else if (name == "nsector" ||
              name == "number-of-background-radial-sectors") {
-    Snake::set_number_of_sectors(String2Unsigned(value));
+    snake_parameters_.set_number_of_sectors(String2Unsigned(value));
   } else if (name == "radial-near") {
-    Snake::set_radial_near(String2Unsigned(value));
+    snake_parameters_.set_radial_near(String2Unsigned(value));
   } else if (name == "radial-far") {
-    Snake::set_radial_far(String2Unsigned(value));
+    snake_parameters_.set_radial_far(String2Unsigned(value));
   } else if (name == "background-z-xy-ratio") {
-    Snake::set_z_spacing(String2Double(value));
+    snake_parameters_.set_z_spacing(String2Double(value));
   } else if (name == "delta") {
-    Snake::set_delta(String2Unsigned(value));
+    snake_parameters_.set_delta(String2Unsigned(value));
   } else if (name == "overlap-threshold") {
-    Snake::set_overlap_threshold(String2Double(value));
+    snake_parameters_.set_overlap_threshold(String2Double(value));
   } else if (name == "grouping-distance-threshold") {
-    Snake::set_grouping_distance_threshold(String2Double(value));
+    snake_parameters_.set_grouping_distance_threshold(String2Double(value));
   } else if (name == "grouping-delta") {
-    Snake::set_grouping_delta(String2Unsigned(value));
+    snake_parameters_.set_grouping_delta(String2Unsigned(value));
   } else if (name == "direction-threshold" ||
              name == "minimum-angle-for-soac-linking") {
-    Snake::set_direction_threshold(String2Double(value));
+    snake_parameters_.set_direction_threshold(String2Double(value));
   } else if (name == "damp-z") {
-    Snake::set_damp_z(value == "true");
+    snake_parameters_.set_damp_z(value == "true");
+  } else if (name == "adaptive-step") {
+    snake_parameters_.set_adaptive_step(value == "true");
   }
 }
 
@@ -278,6 +507,7 @@ void Multisnake::SaveParameters(const std::string &filename) const {
 }
 
 std::ostream & Multisnake::WriteParameters(std::ostream &os) const {
+  const SnakeParameters &p = snake_parameters_;
   os << std::boolalpha;
   os << "intensity-scaling\t" << intensity_scaling_ << std::endl;
   os << "gaussian-std\t" << sigma_ << std::endl;
@@ -285,29 +515,30 @@ std::ostream & Multisnake::WriteParameters(std::ostream &os) const {
   os << "maximum-foreground\t" << foreground_ << std::endl;
   os << "minimum-foreground\t" << background_ << std::endl;
   os << "init-z\t" << initialize_z_ << std::endl;
-  os << "snake-point-spacing\t" << Snake::desired_spacing() << std::endl;
-  os << "minimum-snake-length\t" << Snake::minimum_length() << std::endl;
-  os << "maximum-iterations\t" << Snake::max_iterations() << std::endl;
-  os << "change-threshold\t" << Snake::change_threshold() << std::endl;
-  os << "check-period\t" << Snake::check_period() << std::endl;
+  os << "snake-point-spacing\t" << p.desired_spacing() << std::endl;
+  os << "minimum-snake-length\t" << p.minimum_length() << std::endl;
+  os << "maximum-iterations\t" << p.max_iterations() << std::endl;
+  os << "change-threshold\t" << p.change_threshold() << std::endl;
+  os << "check-period\t" << p.check_period() << std::endl;
   os << "alpha\t" << solver_bank_->alpha() << std::endl;
   os << "beta\t" << solver_bank_->beta() << std::endl;
   os << "gamma\t" << solver_bank_->gamma() << std::endl;
-  os << "external-factor\t" << Snake::external_factor() << std::endl;
-  os << "stretch-factor\t" << Snake::stretch_factor() << std::endl;
+  os << "external-factor\t" << p.external_factor() << std::endl;
+  os << "stretch-factor\t" << p.stretch_factor() << std::endl;
   os << "number-of-background-radial-sectors\t"
-     << Snake::number_of_sectors() << std::endl;
-  os << "background-z-xy-ratio\t" << Snake::z_spacing() << std::endl;
-  os << "radial-near\t" << Snake::radial_near() << std::endl;
-  os << "radial-far\t" << Snake::radial_far() << std::endl;
-  os << "delta\t" << Snake::delta() << std::endl;
-  os << "overlap-threshold\t" << Snake::overlap_threshold() << std::endl;
+     << p.number_of_sectors() << std::endl;
+  os << "background-z-xy-ratio\t" << p.z_spacing() << std::endl;
+  os << "radial-near\t" << p.radial_near() << std::endl;
+  os << "radial-far\t" << p.radial_far() << std::endl;
+  os << "delta\t" << p.delta() << std::endl;
+  os << "overlap-threshold\t" << p.overlap_threshold() << std::endl;
   os << "grouping-distance-threshold\t"
-     << Snake::grouping_distance_threshold() << std::endl;
-  os << "grouping-delta\t" << Snake::grouping_delta() << std::endl;
+     << p.grouping_distance_threshold() << std::endl;
+  os << "grouping-delta\t" << p.grouping_delta() << std::endl;
   os << "minimum-angle-for-soac-linking\t"
-     << Snake::direction_threshold() << std::endl;
-  os << "damp-z\t" << Snake::damp_z() << std::endl;
+     << p.direction_threshold() << std::endl;
+  os << "damp-z\t" << p.damp_z() << std::endl;
+  os << "adaptive-step\t" << p.adaptive_step() << std::endl;
   os << std::noboolalpha;
   return os;
 }
@@ -424,6 +655,35 @@ void Multisnake::InitializeSnakes() {
     this->LinkCandidates(candidate_image, d);
   }
   std::sort(initial_snakes_.begin(), initial_snakes_.end(), IsShorter);
+  if (length_bin_ > 0.0)
+    this->SortSnakesByLocality(initial_snakes_);
+}
+
+/*
+ * Implementation Notes:
+ *
+ * The snakes are sorted by length first, and the stable sort by bin and
+ * key keeps that order among snakes with the same centroid voxel, so
+ * the result depends only on the snakes.
+ */
+void Multisnake::SortSnakesByLocality(SnakeContainer &snakes) const {
+  std::vector<LocalizedSnake> localized(snakes.size());
+  for (unsigned i = 0; i < snakes.size(); ++i) {
+    const Snake *s = snakes[i];
+    PointType centroid;
+    centroid.Fill(0.0);
+    for (unsigned j = 0; j < s->GetSize(); ++j) {
+      for (unsigned k = 0; k < kDimension; ++k)
+        centroid[k] += s->GetPoint(j)[k] / s->GetSize();
+    }
+    localized[i].snake = snakes[i];
+    localized[i].bin = static_cast<int64_t>(
+        std::floor(s->length() / length_bin_));
+    localized[i].key = ComputeMortonKey(centroid);
+  }
+  std::stable_sort(localized.begin(), localized.end());
+  for (unsigned i = 0; i < snakes.size(); ++i)
+    snakes[i] = localized[i].snake;
 }
 
 Multisnake::BoolVectorImageType::Pointer
@@ -578,8 +838,8 @@ void Multisnake::LinkFromIndex(
   }
 
   if (candidates.size() > 1) {
-    Snake *snake = new Snake(candidates, true, false, image_,
-                             external_force_, interpolator_,
+    Snake *snake = new Snake(candidates, &snake_parameters_, true, false,
+                             image_, external_force_, interpolator_,
                              vector_interpolator_, transform_);
     snake->set_initial_state(true);
     snake->Resample();
@@ -633,19 +893,38 @@ bool Multisnake::FindNextCandidate(
   return false;
 }
 
-void Multisnake::DeformSnakes() {
+void Multisnake::DeformSnakes(DeformationScheme scheme) {
   unsigned ncompleted = 0;
   std::cout << "# initial snakes: " << initial_snakes_.size() << std::endl;
   this->ClearSnakeContainer(converged_snakes_);
+  junction_index_.Clear();
+  this->IndexConvergedSnakes();
+
+  number_of_commits_ = 0;
+  number_of_retries_ = 0;
+  number_of_evolutions_ = 0;
+  if (scheme == kTiledDeformation)
+    this->DeformSnakesInTiles(ncompleted);
+  else if (scheme == kOptimisticDeformation)
+    this->DeformSnakesOptimistically(ncompleted);
+  else if (scheme == kConcurrentDeformation)
+    this->DeformSnakesConcurrently(ncompleted);
+  else if (scheme == kDeterministicDeformation)
+    this->DeformSnakesDeterministically(ncompleted);
+  this->DeformSnakesSerially(ncompleted);
+  std::cout << "\n# Converged snakes: " << converged_snakes_.size()
+            << std::endl;
+}
 
+void Multisnake::DeformSnakesSerially(unsigned &ncompleted) {
   while (!initial_snakes_.empty()) {
     Snake *snake = initial_snakes_.back();
     initial_snakes_.pop_back();
     solver_bank_->Reset(false);
-    snake->Evolve(solver_bank_, converged_snakes_, kBigNumber, dim_);
+    snake->Evolve(solver_bank_, converged_index_, kBigNumber, dim_);
 
     if (snake->viable()) {
-      converged_snakes_.push_back(snake);
+      this->AddConvergedSnake(snake);
     } else {
       initial_snakes_.insert(initial_snakes_.end(),
                              snake->subsnakes().begin(),
@@ -659,8 +938,393 @@ void Multisnake::DeformSnakes() {
               << initial_snakes_.size() << std::flush;
     qApp->processEvents();
   }
-  std::cout << "\n# Converged snakes: " << converged_snakes_.size()
-            << std::endl;
+}
+
+/*
+ * Implementation Notes:
+ *
+ * A round takes the snakes the serial loop would evolve next, evolves
+ * them concurrently against the converged snakes as they are at the
+ * start of the round, and commits them in the order of the serial loop.
+ * Each snake is checked against the snakes committed earlier in the
+ * round, and an invalid one is evolved again in the next round, which
+ * it leads. The first snake of a round is always valid, so every round
+ * commits at least one snake. The results depend on the size of the
+ * rounds but not on the timing of the threads.
+ */
+void Multisnake::DeformSnakesOptimistically(unsigned &ncompleted) {
+  const double margin = 2 * snake_parameters_.overlap_threshold();
+  std::vector<SolverBank *> solvers;
+  this->CreateSolverBanks(solvers);
+  const unsigned round_size = 4 * solvers.size();
+
+  std::vector<Speculation> round;
+  SnakeContainer committed_snakes, retried_snakes;
+  while (!initial_snakes_.empty()) {
+    round.clear();
+    while (round.size() < round_size && !initial_snakes_.empty()) {
+      Speculation spec;
+      spec.snake = initial_snakes_.back();
+      spec.snapshot = converged_snakes_.size();
+      initial_snakes_.pop_back();
+      round.push_back(spec);
+    }
+    number_of_evolutions_ += round.size();
+
+    ParallelForEach(round.size(), [&](unsigned i, unsigned thread) {
+        EvolveSpeculatively(&round[i], converged_index_, solvers[thread],
+                            margin, dim_);
+      }, solvers.size());
+
+    committed_snakes.clear();
+    retried_snakes.clear();
+    for (std::vector<Speculation>::iterator it = round.begin();
+         it != round.end(); ++it) {
+      Snake *snake = it->snake;
+      bool valid = true;
+      for (SnakeConstIterator s = committed_snakes.begin();
+           valid && s != committed_snakes.end(); ++s)
+        valid = !HasVertexInBox(**s, it->low, it->high);
+
+      if (!valid) {
+        retried_snakes.push_back(DiscardSpeculation(*it));
+        number_of_retries_++;
+        continue;
+      }
+
+      delete it->start;
+      number_of_commits_++;
+      if (snake->viable()) {
+        this->AddConvergedSnake(snake);
+        committed_snakes.push_back(snake);
+      } else {
+        initial_snakes_.insert(initial_snakes_.end(),
+                               snake->subsnakes().begin(),
+                               snake->subsnakes().end());
+        delete snake;
+      }
+      ncompleted++;
+    }
+    initial_snakes_.insert(initial_snakes_.end(), retried_snakes.rbegin(),
+                           retried_snakes.rend());
+
+    emit ExtractionProgressed(ncompleted);
+    std::cout << "\rRemaining: " << std::setw(6)
+              << initial_snakes_.size() << std::flush;
+    qApp->processEvents();
+  }
+
+  for (unsigned t = 1; t < solvers.size(); ++t)
+    delete solvers[t];
+  std::cout << "\n# commits: " << number_of_commits_ << ", retries: "
+            << number_of_retries_;
+}
+
+/*
+ * Implementation Notes:
+ *
+ * Each thread repeatedly pops the snake on top of the stack of the
+ * serial loop, evolves it against a snapshot of the registry of
+ * converged snakes, and commits it under a lock. The snake is checked
+ * against the snakes added to the registry after its snapshot, and an
+ * invalid one is pushed back on top of the stack.
+ *
+ * There is no barrier between the threads, and the snapshots lag the
+ * commits by the time it takes to publish them, so the results depend
+ * on the timing of the threads. A thread with nothing to pop waits for
+ * the others, whose commits may push subsnakes or retries. Only the
+ * calling thread reports progress. Every snake popped is either
+ * committed or pushed back as a retry, so the number of evolutions must
+ * be the sum of the commits and the retries.
+ */
+void Multisnake::DeformSnakesConcurrently(unsigned &ncompleted) {
+  const double margin = 2 * snake_parameters_.overlap_threshold();
+  std::vector<SolverBank *> solvers;
+  this->CreateSolverBanks(solvers);
+  const unsigned calling_thread = solvers.size() - 1;
+
+  SnakeRegistry registry(converged_index_.cell_size());
+  for (SnakeConstIterator it = converged_snakes_.begin();
+       it != converged_snakes_.end(); ++it)
+    registry.Add(*it);
+
+  std::mutex mutex;
+  std::condition_variable popped;
+  unsigned num_evolving = 0;
+  ParallelForEach(solvers.size(), [&](unsigned, unsigned thread) {
+      for (;;) {
+        Speculation spec;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          popped.wait(lock, [&] {
+              return !initial_snakes_.empty() || num_evolving == 0;
+            });
+          if (initial_snakes_.empty()) break;
+          spec.snake = initial_snakes_.back();
+          initial_snakes_.pop_back();
+          number_of_evolutions_++;
+          num_evolving++;
+        }
+
+        {
+          SnakeRegistry::Snapshot snapshot(registry);
+          spec.snapshot = snapshot.size();
+          EvolveSpeculatively(&spec, snapshot.index(), solvers[thread],
+                              margin, dim_);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        const SnakeContainer &committed_snakes = registry.snakes();
+        bool valid = true;
+        for (unsigned i = spec.snapshot;
+             valid && i < committed_snakes.size(); ++i)
+          valid = !HasVertexInBox(*committed_snakes[i], spec.low, spec.high);
+
+        if (valid) {
+          delete spec.start;
+          number_of_commits_++;
+          if (spec.snake->viable()) {
+            this->AddConvergedSnake(spec.snake);
+            registry.Add(spec.snake);
+          } else {
+            initial_snakes_.insert(initial_snakes_.end(),
+                                   spec.snake->subsnakes().begin(),
+                                   spec.snake->subsnakes().end());
+            delete spec.snake;
+          }
+          ncompleted++;
+        } else {
+          initial_snakes_.push_back(DiscardSpeculation(spec));
+          number_of_retries_++;
+          registry.Publish();
+        }
+        num_evolving--;
+        popped.notify_all();
+
+        if (thread == calling_thread) {
+          const unsigned completed = ncompleted;
+          const std::size_t remaining = initial_snakes_.size();
+          lock.unlock();
+          emit ExtractionProgressed(completed);
+          std::cout << "\rRemaining: " << std::setw(6) << remaining
+                    << std::flush;
+          qApp->processEvents();
+        }
+      }
+    }, solvers.size());
+  assert(number_of_evolutions_ == number_of_commits_ + number_of_retries_);
+
+  for (unsigned t = 1; t < solvers.size(); ++t)
+    delete solvers[t];
+  std::cout << "\n# commits: " << number_of_commits_ << ", retries: "
+            << number_of_retries_;
+}
+
+/*
+ * Implementation Notes:
+ *
+ * The serial loop is followed exactly, while the snakes near the top of
+ * its stack are evolved ahead of time. A round evolves concurrently the
+ * snakes among the top few that have no result yet, against the
+ * converged snakes at the start of the round. The results are then
+ * committed from the top of the stack for as long as the top has one.
+ *
+ * A result is checked against the snakes converged after its evolution
+ * started. The answers of all the queries of a valid result are then
+ * the same as against every converged snake, ties included, since the
+ * index is ordered by convergence. A valid result is thus what the
+ * serial loop computes, to the bit. An invalid one is evolved again by
+ * the next round against the up-to-date converged snakes.
+ */
+void Multisnake::DeformSnakesDeterministically(unsigned &ncompleted) {
+  const double margin = 2 * snake_parameters_.overlap_threshold();
+  std::vector<SolverBank *> solvers;
+  this->CreateSolverBanks(solvers);
+  const std::size_t window = 4 * solvers.size();
+
+  typedef std::unordered_map<Snake *, Speculation> SpeculationMap;
+  SpeculationMap speculations;
+  std::vector<Speculation *> round;
+  while (!initial_snakes_.empty()) {
+    round.clear();
+    const std::size_t depth = std::min(window, initial_snakes_.size());
+    for (std::size_t i = 1; i <= depth; ++i) {
+      Snake *snake = initial_snakes_[initial_snakes_.size() - i];
+      if (speculations.count(snake)) continue;
+      Speculation &spec = speculations[snake];
+      spec.snake = snake;
+      spec.snapshot = converged_snakes_.size();
+      round.push_back(&spec);
+    }
+    number_of_evolutions_ += round.size();
+
+    ParallelForEach(round.size(), [&](unsigned i, unsigned thread) {
+        EvolveSpeculatively(round[i], converged_index_, solvers[thread],
+                            margin, dim_);
+      }, solvers.size());
+
+    while (!initial_snakes_.empty()) {
+      SpeculationMap::iterator it = speculations.find(initial_snakes_.back());
+      if (it == speculations.end()) break;
+      const Speculation spec = it->second;
+      speculations.erase(it);
+
+      bool valid = true;
+      for (unsigned i = spec.snapshot;
+           valid && i < converged_snakes_.size(); ++i)
+        valid = !HasVertexInBox(*converged_snakes_[i], spec.low, spec.high);
+      if (!valid) {
+        initial_snakes_.back() = DiscardSpeculation(spec);
+        number_of_retries_++;
+        break;
+      }
+
+      delete spec.start;
+      initial_snakes_.pop_back();
+      number_of_commits_++;
+      if (spec.snake->viable()) {
+        this->AddConvergedSnake(spec.snake);
+      } else {
+        initial_snakes_.insert(initial_snakes_.end(),
+                               spec.snake->subsnakes().begin(),
+                               spec.snake->subsnakes().end());
+        delete spec.snake;
+      }
+      ncompleted++;
+    }
+
+    emit ExtractionProgressed(ncompleted);
+    std::cout << "\rRemaining: " << std::setw(6)
+              << initial_snakes_.size() << std::flush;
+    qApp->processEvents();
+  }
+
+  for (unsigned t = 1; t < solvers.size(); ++t)
+    delete solvers[t];
+  std::cout << "\n# commits: " << number_of_commits_ << ", retries: "
+            << number_of_retries_;
+}
+
+void Multisnake::CreateSolverBanks(std::vector<SolverBank *> &solvers) const {
+  unsigned num_threads = solver_bank_->direct() ? number_of_threads_ : 1;
+  if (num_threads == 0)
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  solvers.assign(1, solver_bank_);
+  for (unsigned t = 1; t < num_threads; ++t) {
+    SolverBank *solver = new SolverBank;
+    solver->set_alpha(solver_bank_->alpha());
+    solver->set_beta(solver_bank_->beta());
+    solver->set_gamma(solver_bank_->gamma());
+    solver->set_direct(solver_bank_->direct());
+    solver->set_factorization_cache(solver_bank_->factorization_cache());
+    solvers.push_back(solver);
+  }
+}
+
+/*
+ * Implementation Notes:
+ *
+ * A snake is evolved in a tile only while its bounding box grown by
+ * twice the overlap threshold lies inside the tile. The overlap queries
+ * of one iteration reach no further than that from the vertices, and
+ * tiles of the same color are a tile apart, so the snakes evolving
+ * concurrently can neither touch nor see each other. Each snake thus
+ * sees every converged snake it could have met in the serial loop run in
+ * the order of the merge below, and hooks and overlaps as it would
+ * there. The snakes leaving their tile are started over in the serial
+ * pass after all tiles, and the result does not depend on the number of
+ * threads.
+ *
+ * The ITPACK solvers are not thread-safe, so CreateSolverBanks leaves
+ * a single bank, and the tiles are evolved in the calling thread,
+ * unless the direct solvers are used.
+ */
+void Multisnake::DeformSnakesInTiles(unsigned &ncompleted) {
+  const unsigned num_colors = 1 << kDimension;
+  const double margin = 2 * snake_parameters_.overlap_threshold();
+  // A tile holds at least a margin on each side, and has a positive
+  // size even when the overlap threshold is 0.
+  const double tile_size = std::max(std::max(tile_size_, 2 * margin),
+                                    converged_index_.cell_size());
+
+  std::map<uint64_t, Tile> tiles;
+  SnakeContainer crossing_snakes;
+  for (SnakeConstIterator it = initial_snakes_.begin();
+       it != initial_snakes_.end(); ++it) {
+    int64_t cell[kDimension];
+    if (!FindTile(**it, tile_size, margin, cell)) {
+      crossing_snakes.push_back(*it);
+      continue;
+    }
+    Tile &tile = tiles[SnakeIndex::ComputeKey(cell[0], cell[1], cell[2])];
+    if (tile.snakes.empty()) {
+      tile.color = 0;
+      for (unsigned k = 0; k < kDimension; ++k) {
+        tile.cell[k] = cell[k];
+        tile.color |= (cell[k] & 1) << k;
+      }
+      tile.ncompleted = 0;
+    }
+    tile.snakes.push_back(*it);
+  }
+  initial_snakes_.clear();
+  std::cout << "# tiles: " << tiles.size() << ", crossing snakes: "
+            << crossing_snakes.size() << std::endl;
+
+  std::vector<SolverBank *> solvers;
+  this->CreateSolverBanks(solvers);
+
+  SnakeContainer deferred_snakes;
+  for (unsigned color = 0; color < num_colors; ++color) {
+    std::vector<Tile *> phase;
+    for (std::map<uint64_t, Tile>::iterator it = tiles.begin();
+         it != tiles.end(); ++it) {
+      if (it->second.color == color)
+        phase.push_back(&it->second);
+    }
+
+    ParallelForEach(phase.size(), [&](unsigned i, unsigned thread) {
+        EvolveTile(phase[i], converged_index_, solvers[thread], tile_size,
+                   margin, dim_);
+      }, solvers.size());
+
+    for (std::vector<Tile *>::iterator it = phase.begin();
+         it != phase.end(); ++it) {
+      Tile *tile = *it;
+      for (SnakeConstIterator s = tile->converged_snakes.begin();
+           s != tile->converged_snakes.end(); ++s)
+        this->AddConvergedSnake(*s);
+      deferred_snakes.insert(deferred_snakes.end(),
+                             tile->deferred_snakes.begin(),
+                             tile->deferred_snakes.end());
+      ncompleted += tile->ncompleted;
+    }
+    std::size_t remaining = deferred_snakes.size() + crossing_snakes.size();
+    for (std::map<uint64_t, Tile>::const_iterator it = tiles.begin();
+         it != tiles.end(); ++it)
+      remaining += it->second.snakes.size();
+    emit ExtractionProgressed(ncompleted);
+    std::cout << "\rRemaining: " << std::setw(6) << remaining << std::flush;
+    qApp->processEvents();
+  }
+
+  for (unsigned t = 1; t < solvers.size(); ++t)
+    delete solvers[t];
+
+  // The serial pass pops from the back, so the crossing snakes keep
+  // their order and go first.
+  initial_snakes_ = deferred_snakes;
+  initial_snakes_.insert(initial_snakes_.end(), crossing_snakes.begin(),
+                         crossing_snakes.end());
+}
+
+void Multisnake::IndexConvergedSnakes() {
+  const double threshold = snake_parameters_.overlap_threshold();
+  converged_index_.Reset(threshold > 0.0 ? threshold : 1.0);
+  for (SnakeConstIterator it = converged_snakes_.begin();
+       it != converged_snakes_.end(); ++it) {
+    converged_index_.AddSnake(*it);
+  }
 }
 
 void Multisnake::CutSnakesAtTJunctions() {
@@ -668,8 +1332,17 @@ void Multisnake::CutSnakesAtTJunctions() {
   this->CutSnakes(segments);
   this->ClearSnakeContainer(converged_snakes_);
   converged_snakes_ = segments;
+  junction_index_.Clear();
 }
 
+/*
+ * Implementation Notes:
+ *
+ * UpdateHookedIndices adds junction indices to the hooked snakes, so it
+ * stays serial. CopySubSnakes only reads its snake, and the subsnakes of
+ * each snake are collected apart and appended in the order of the
+ * converged snakes.
+ */
 void Multisnake::CutSnakes(SnakeContainer &seg) {
   if (converged_snakes_.empty()) return;
   for (SnakeIterator it = converged_snakes_.begin();
@@ -677,10 +1350,13 @@ void Multisnake::CutSnakes(SnakeContainer &seg) {
     (*it)->UpdateHookedIndices();
   }
 
-  for (SnakeIterator it = converged_snakes_.begin();
-       it != converged_snakes_.end(); ++it) {
-    (*it)->CopySubSnakes(seg);
-  }
+  std::vector<SnakeContainer> subsnakes(converged_snakes_.size());
+  ParallelFor(converged_snakes_.size(), [&](unsigned begin, unsigned end) {
+      for (unsigned i = begin; i < end; ++i)
+        converged_snakes_[i]->CopySubSnakes(subsnakes[i]);
+    }, number_of_threads_);
+  for (unsigned i = 0; i < subsnakes.size(); ++i)
+    seg.insert(seg.end(), subsnakes[i].begin(), subsnakes[i].end());
 }
 
 void Multisnake::ClearSnakeContainer(SnakeContainer &snakes) {
@@ -692,16 +1368,40 @@ void Multisnake::ClearSnakeContainer(SnakeContainer &snakes) {
   snakes.clear();
 }
 
+/*
+ * Implementation Notes:
+ *
+ * The linked snakes evolve independently, and a batch evolution gives
+ * each snake the same result as evolving it alone. They are thus split
+ * into contiguous chunks evolved as batches on the threads, several
+ * chunks per thread to even out the load, with the same result as one
+ * batch.
+ */
 void Multisnake::GroupSnakes() {
   if (converged_snakes_.empty()) return;
+  junction_index_.Clear();
   junctions_.Initialize(converged_snakes_);
   junctions_.Union();
   junctions_.Configure();
   this->LinkSegments(converged_snakes_);
+
+  std::vector<SolverBank *> solvers;
+  this->CreateSolverBanks(solvers);
+  const unsigned size = converged_snakes_.size();
+  const unsigned num_chunks = solvers.size() > 1 ?
+      std::min(4 * static_cast<unsigned>(solvers.size()), size) : 1;
+  ParallelForEach(num_chunks, [&](unsigned i, unsigned thread) {
+      const SnakeContainer chunk(
+          converged_snakes_.begin() + size * i / num_chunks,
+          converged_snakes_.begin() + size * (i + 1) / num_chunks);
+      solvers[thread]->Reset(false);
+      Snake::EvolveBatchWithTipFixed(solvers[thread], chunk, 100, dim_);
+    }, solvers.size());
+  for (unsigned t = 1; t < solvers.size(); ++t)
+    delete solvers[t];
+
   SnakeIterator it = converged_snakes_.begin();
   while (it != converged_snakes_.end()) {
-    solver_bank_->Reset(false);
-    (*it)->EvolveWithTipFixed(solver_bank_, 100, dim_);
     if ((*it)->viable()) {
       it++;
     } else {
@@ -714,18 +1414,20 @@ void Multisnake::GroupSnakes() {
 
 void Multisnake::LinkSegments(SnakeContainer &seg) {
   SnakeContainer c;
-  std::reverse(seg.begin(), seg.end());
-  while (!seg.empty()) {
-    Snake *segment = seg.back();
-    seg.pop_back();
-    // log is for detecting loop in linking snake segments
-    SnakeSet log;
+  // Segments are linked in order. The ones already linked into an
+  // earlier snake are skipped rather than erased from seg. Tip links are
+  // symmetric, so while following a chain, meeting a linked segment
+  // means the chain is a loop.
+  LinkedSnakeSet linked;
+  for (SnakeConstIterator it = seg.begin(); it != seg.end(); ++it) {
+    Snake *segment = *it;
+    if (linked.find(segment) != linked.end()) continue;
     PointContainer points;
     bool is_open = true;
-    this->LinkFromSegment(segment, seg, log, points, is_open);
+    this->LinkFromSegment(segment, linked, points, is_open);
     delete segment;
-    Snake *s = new Snake(points, is_open, false, image_,
-                         external_force_, interpolator_,
+    Snake *s = new Snake(points, &snake_parameters_, is_open, false,
+                         image_, external_force_, interpolator_,
                          vector_interpolator_, transform_);
     s->Resample();
     c.push_back(s);
@@ -733,39 +1435,30 @@ void Multisnake::LinkSegments(SnakeContainer &seg) {
   converged_snakes_ = c;
 }
 
-void Multisnake::LinkFromSegment(Snake *s, SnakeContainer &seg,
-                                 SnakeSet &log, PointContainer &pc,
-                                 bool &is_open) {
-  log.insert(s);
+void Multisnake::LinkFromSegment(Snake *s, LinkedSnakeSet &linked,
+                                 PointContainer &pc, bool &is_open) {
+  linked.insert(s);
   pc = s->vertices();
   SnakeTip * t = junctions_.FindSnakeTip(s, true);
-  this->LinkFromSegmentTip(t->neighbor(), pc, is_open, seg, log, true);
+  this->LinkFromSegmentTip(t->neighbor(), pc, is_open, linked, true);
   t = junctions_.FindSnakeTip(s, false);
-  this->LinkFromSegmentTip(t->neighbor(), pc, is_open, seg, log, false);
+  this->LinkFromSegmentTip(t->neighbor(), pc, is_open, linked, false);
 }
 
 void Multisnake::LinkFromSegmentTip(SnakeTip *neighbor, PointContainer &pc,
-                                    bool &is_open, SnakeContainer &seg,
-                                    SnakeSet &log, bool from_head) {
-  if (!neighbor) {
-    return;
-  } else if (log.find(neighbor->snake()) != log.end()) {
-    is_open = false;
-    return;
-  } else {
-    this->AddToPointContainer(pc, neighbor->snake(), neighbor->is_head(),
-                              from_head);
-    SnakeContainer::iterator it = std::find(seg.begin(), seg.end(),
-                                            neighbor->snake());
-    if (it != seg.end())
-      seg.erase(it);
-
-    log.insert(neighbor->snake());
-    delete neighbor->snake();
-    SnakeTip * t = junctions_.FindSnakeTip(neighbor->snake(),
-                                           !neighbor->is_head());
-    this->LinkFromSegmentTip(t->neighbor(), pc, is_open, seg, log,
-                             from_head);
+                                    bool &is_open, LinkedSnakeSet &linked,
+                                    bool from_head) {
+  while (neighbor) {
+    Snake *s = neighbor->snake();
+    if (linked.find(s) != linked.end()) {
+      is_open = false;
+      return;
+    }
+    this->AddToPointContainer(pc, s, neighbor->is_head(), from_head);
+    linked.insert(s);
+    SnakeTip * t = junctions_.FindSnakeTip(s, !neighbor->is_head());
+    delete s;
+    neighbor = t->neighbor();
   }
 }
 
@@ -787,27 +1480,34 @@ void Multisnake::AddToPointContainer(PointContainer &pc, Snake *s,
 void Multisnake::UpdateJunctions() {
   if (converged_snakes_.empty())
     junctions_.ClearJunctionPoints();
+  this->IndexJunctionSnakes();
+  this->ValidateJunctions();
+}
+
+bool Multisnake::ValidateJunctions() {
+  if (junction_index_.empty() && !converged_snakes_.empty())
+    this->IndexJunctionSnakes();
 
+  const double dist_threshold = snake_parameters_.grouping_distance_threshold();
   const PointContainer &junction_points = junctions_.junction_points();
   PointContainer new_junction_points;
   for (PointConstIterator it = junction_points.begin();
        it != junction_points.end(); ++it) {
-    unsigned num_of_close_snake = GetNumberOfSnakesCloseToPoint(*it);
-    if (num_of_close_snake > 1)
+    if (junction_index_.CountSnakesWithin(*it, dist_threshold) > 1)
       new_junction_points.push_back(*it);
   }
+  if (new_junction_points.size() == junction_points.size()) return false;
   junctions_.set_junction_points(new_junction_points);
+  return true;
 }
 
-unsigned Multisnake::GetNumberOfSnakesCloseToPoint(const PointType &p) {
-  unsigned num = 0;
-  const double dist_threshold = Snake::grouping_distance_threshold();
-  for (SnakeContainer::const_iterator it = converged_snakes_.begin();
+void Multisnake::IndexJunctionSnakes() {
+  const double dist_threshold = snake_parameters_.grouping_distance_threshold();
+  junction_index_.Reset(dist_threshold > 0.0 ? dist_threshold : 1.0);
+  for (SnakeConstIterator it = converged_snakes_.begin();
        it != converged_snakes_.end(); ++it) {
-    if ((*it)->PassThrough(p, dist_threshold))
-      num++;
+    junction_index_.AddSnake(*it);
   }
-  return num;
 }
 
 void Multisnake::LoadSnakes(const std::string &filename,
@@ -831,8 +1531,9 @@ void Multisnake::LoadSnakes(const std::string &filename,
       this->AssignParameters(name, value);
     } else if (line[0] == '#') {
       if (points.size() > 1) {
-        Snake *s = new Snake(points, is_open, false, image_, external_force_,
-                             interpolator_, vector_interpolator_, transform_);
+        Snake *s = new Snake(points, &snake_parameters_, is_open, false,
+                             image_, external_force_, interpolator_,
+                             vector_interpolator_, transform_);
         snakes.push_back(s);
         s->Resample();
       }
@@ -854,8 +1555,9 @@ void Multisnake::LoadSnakes(const std::string &filename,
   infile.close();
 
   if (points.size() > 1) {
-    Snake *s = new Snake(points, is_open, false, image_, external_force_,
-                         interpolator_, vector_interpolator_, transform_);
+    Snake *s = new Snake(points, &snake_parameters_, is_open, false,
+                         image_, external_force_, interpolator_,
+                         vector_interpolator_, transform_);
     snakes.push_back(s);
     s->Resample();
   }
@@ -881,8 +1583,9 @@ void Multisnake::LoadJFilamentSnakes(const std::string &filename,
       continue;
     } else if (line[0] == '#') {
       if (points.size() > 1) {
-        Snake *s = new Snake(points, is_open, false, image_, external_force_,
-                             interpolator_, vector_interpolator_, transform_);
+        Snake *s = new Snake(points, &snake_parameters_, is_open, false,
+                             image_, external_force_, interpolator_,
+                             vector_interpolator_, transform_);
         snakes.push_back(s);
         s->Resample();
       }
@@ -909,8 +1612,9 @@ void Multisnake::LoadJFilamentSnakes(const std::string &filename,
   infile.close();
 
   if (points.size() > 1) {
-    Snake *s = new Snake(points, is_open, false, image_, external_force_,
-                         interpolator_, vector_interpolator_, transform_);
+    Snake *s = new Snake(points, &snake_parameters_, is_open, false,
+                         image_, external_force_, interpolator_,
+                         vector_interpolator_, transform_);
     snakes.push_back(s);
     s->Resample();
   }
@@ -994,13 +1698,13 @@ void Multisnake::SaveJFilamentSnakes(const SnakeContainer &snakes,
   }
 
   outfile << "gamma\t" << solver_bank_->gamma() << std::endl;
-  outfile << "weight\t" << Snake::external_factor() << std::endl;
+  outfile << "weight\t" << snake_parameters_.external_factor() << std::endl;
   outfile << "zresolution\t" << 1.0 << std::endl;
   outfile << "background\t" << background_ << std::endl;
   outfile << "alpha\t" << solver_bank_->alpha() << std::endl;
   outfile << "smoothing\t" << sigma_ << std::endl;
-  outfile << "stretch\t" << Snake::stretch_factor() << std::endl;
-  outfile << "spacing\t" << Snake::desired_spacing() << std::endl;
+  outfile << "stretch\t" << snake_parameters_.stretch_factor() << std::endl;
+  outfile << "spacing\t" << snake_parameters_.desired_spacing() << std::endl;
   outfile << "beta\t" << solver_bank_->beta() << std::endl;
   outfile << "foreground\t" << foreground_ << std::endl;
 
@@ -1029,40 +1733,32 @@ void Multisnake::PrintSnakes(const SnakeContainer &snakes) const {
 
 void Multisnake::ComputeErrorFromSnakesToComparingSnakes(
     DataContainer &errors) const {
-  for (SnakeConstIterator iter = converged_snakes_.begin();
-       iter != converged_snakes_.end(); ++iter) {
-    for (unsigned i = 0; i < (*iter)->GetSize(); ++i) {
-      double dist = this->ComputeShortestDistance((*iter)->GetPoint(i),
-                                                  comparing_snakes1_);
-      errors.push_back(dist);
-    }
-  }
+  this->ComputeShortestDistances(converged_snakes_, comparing_snakes1_,
+                                 errors);
 }
 
 void Multisnake::ComputeErrorFromComparingSnakesToSnakes(
     DataContainer &errors) const {
-  for (SnakeConstIterator iter = comparing_snakes1_.begin();
-       iter != comparing_snakes1_.end(); ++iter) {
-    for (unsigned i = 0; i < (*iter)->GetSize(); ++i) {
-      double dist = this->ComputeShortestDistance((*iter)->GetPoint(i),
-                                                  converged_snakes_);
-      errors.push_back(dist);
-    }
-  }
+  this->ComputeShortestDistances(comparing_snakes1_, converged_snakes_,
+                                 errors);
 }
 
-double Multisnake::ComputeShortestDistance(
-    const PointType &p, const SnakeContainer &snakes) const {
-  double min_dist = kPlusInfinity;
-  for (SnakeConstIterator iter = snakes.begin();
-       iter != snakes.end(); ++iter) {
-    for (unsigned i = 0; i < (*iter)->GetSize(); ++i) {
-      double dist = p.EuclideanDistanceTo((*iter)->GetPoint(i));
-      if (dist < min_dist)
-        min_dist = dist;
-    }
+void Multisnake::ComputeShortestDistances(const SnakeContainer &snakes,
+                                          const SnakeContainer &targets,
+                                          DataContainer &distances) const {
+  const VertexTree tree(targets);
+  std::vector<PointType> points;
+  for (SnakeConstIterator it = snakes.begin(); it != snakes.end(); ++it) {
+    for (unsigned i = 0; i < (*it)->GetSize(); ++i)
+      points.push_back((*it)->GetPoint(i));
   }
-  return min_dist;
+
+  const unsigned offset = distances.size();
+  distances.resize(offset + points.size());
+  ParallelFor(points.size(), [&](unsigned begin, unsigned end) {
+    for (unsigned i = begin; i < end; ++i)
+      distances[offset + i] = tree.ComputeShortestDistance(points[i]);
+  }, number_of_threads_);
 }
 
 void Multisnake::ComputeSphericalOrientation(
@@ -1252,6 +1948,7 @@ void Multisnake::DeleteSnakes(const SnakeSet &snakes) {
                                   converged_snakes_.end(), *it);
     if (it2 != converged_snakes_.end()) {
       converged_snakes_.erase(it2);
+      junction_index_.RemoveSnake(*it);
     } else {
       std::cout << "Couldn't locate snake " << *it << " in converged snakes."
                 << std::endl;
@@ -11,9 +11,12 @@
 #define MULTISNAKE_H_
 
 #include <string>
+#include <unordered_set>
 #include <QObject>  // NOLINT(build/include_order)
 #include "./global.h"
 #include "./snake.h"
+#include "./snake_index.h"
+#include "./snake_parameters.h"
 #include "./junctions.h"
 
 
@@ -32,6 +35,34 @@ class Multisnake : public QObject {
  public:
   typedef itk::Image<double, kDimension> FloatImageType;
 
+  /*
+   * Ways of deforming the initial snakes. kSerialDeformation evolves
+   * them one at a time against all the snakes converged before.
+   * kTiledDeformation splits the volume into cubic tiles and evolves
+   * the snakes lying inside non-adjacent tiles concurrently, leaving the
+   * snakes that cross tile borders to a final serial pass.
+   * kOptimisticDeformation evolves rounds of snakes concurrently against
+   * the snakes converged before the round, and evolves again those that
+   * may have met a snake committed earlier in the same round; its results
+   * depend on the number of threads but not on their timing.
+   * kDeterministicDeformation evolves the snakes on top of the stack of
+   * the serial loop concurrently and commits them in the serial order,
+   * evolving again those that may have met a snake committed after they
+   * started. Its converged snakes are the same as those of
+   * kSerialDeformation for any number of threads.
+   * kConcurrentDeformation evolves snakes on all threads without rounds,
+   * against snapshots of the converged snakes, and evolves again those
+   * that may have met a snake committed after their snapshot. Its results
+   * depend on the timing of the threads and may differ from run to run.
+   */
+  enum DeformationScheme {
+    kSerialDeformation,
+    kTiledDeformation,
+    kOptimisticDeformation,
+    kDeterministicDeformation,
+    kConcurrentDeformation
+  };
+
   explicit Multisnake(QObject *parent = 0);
   ~Multisnake();
   void Reset();
@@ -58,6 +89,25 @@ class Multisnake : public QObject {
   ImageType::Pointer image() const {return image_;}
   VectorImageType::Pointer external_force() const {return external_force_;}
 
+  /*
+   * Use the image and the image gradient of source instead of loading
+   * and computing them again. They are only read during extraction, so
+   * multisnakes sharing them can extract concurrently, each with its
+   * own parameters.
+   */
+  void ShareImage(const Multisnake &source);
+
+  /*
+   * Parameters of the snakes of this multisnake. Every snake refers to
+   * them, so they must only be replaced between extractions.
+   */
+  const SnakeParameters &snake_parameters() const {
+    return snake_parameters_;
+  }
+  void set_snake_parameters(const SnakeParameters &parameters) {
+    snake_parameters_ = parameters;
+  }
+
   void LoadParameters(const std::string &filename);
   void UpdateSnakeParameters();
   void SaveParameters(const std::string &filename) const;
@@ -92,10 +142,47 @@ class Multisnake : public QObject {
   bool initialize_z() const {return initialize_z_;}
   void set_initialize_z(bool init_z) {initialize_z_ = init_z;}
 
+  /*
+   * Width of the length bins of the initial snakes. If it is positive,
+   * InitializeSnakes orders the snakes by length bin, and by the Morton
+   * key of their centroids within a bin, so that the snakes evolved one
+   * after the other lie close together and sample the same part of the
+   * image. Otherwise the snakes are ordered by length only. Since the
+   * order decides which of two overlapping snakes converges first, a
+   * positive width changes the converged snakes, not only the time it
+   * takes to get them.
+   */
+  double length_bin() const {return length_bin_;}
+  void set_length_bin(double width) {length_bin_ = width;}
+
   unsigned dim() const {return dim_;}
 
   SolverBank *solver_bank() const {return solver_bank_;}
 
+  /*
+   * Number of threads used by the parallel deformation schemes, the
+   * grouping, the cutting at T-junctions and the vertex errors against
+   * the comparing snakes. 0 means one thread per hardware thread.
+   */
+  unsigned number_of_threads() const {return number_of_threads_;}
+  void set_number_of_threads(unsigned n) {number_of_threads_ = n;}
+
+  /*
+   * Edge length of the tiles of kTiledDeformation in pixels.
+   */
+  double tile_size() const {return tile_size_;}
+  void set_tile_size(double size) {tile_size_ = size;}
+
+  /*
+   * Numbers of speculative evolutions, of snakes committed and of
+   * snakes evolved again by the last kOptimisticDeformation,
+   * kDeterministicDeformation or kConcurrentDeformation. Every evolution
+   * ends in a commit or a retry, so the first is the sum of the others.
+   */
+  unsigned number_of_evolutions() const {return number_of_evolutions_;}
+  unsigned number_of_commits() const {return number_of_commits_;}
+  unsigned number_of_retries() const {return number_of_retries_;}
+
   void InvertImageIntensity();
 
   /*
@@ -123,6 +210,14 @@ class Multisnake : public QObject {
   const SnakeContainer &converged_snakes() const {
     return converged_snakes_;
   }
+
+  /*
+   * Spatial index of the converged snakes to evolve new snakes against.
+   * It is kept up to date by DeformSnakes and AddConvergedSnake; call
+   * IndexConvergedSnakes after changing the converged snakes otherwise.
+   */
+  const SnakeIndex &converged_index() const {return converged_index_;}
+  void IndexConvergedSnakes();
   const SnakeContainer &comparing_snakes1() const {
     return comparing_snakes1_;
   }
@@ -135,7 +230,7 @@ class Multisnake : public QObject {
     this->SaveJFilamentSnakes(converged_snakes_, filename);
   }
 
-  void DeformSnakes();
+  void DeformSnakes(DeformationScheme scheme = kSerialDeformation);
   void CutSnakesAtTJunctions();
   void GroupSnakes();
 
@@ -144,8 +239,30 @@ class Multisnake : public QObject {
     return junctions_.junction_points();
   }
 
+  /*
+   * Spatial index of the converged snakes used to validate junctions,
+   * with a cell size of the grouping distance threshold. It is built by
+   * GroupSnakes and follows DeleteSnakes. Snakes edited in place are not
+   * reindexed; call InvalidateJunctionIndex after editing them.
+   */
+  const SnakeIndex &junction_index() const {return junction_index_;}
+
+  /*
+   * Drop the junction index, so that ValidateJunctions rebuilds it from
+   * the current vertices.
+   */
+  void InvalidateJunctionIndex() {junction_index_.Clear();}
+
+  /*
+   * Keep only the junction points that have more than one converged
+   * snake within the grouping distance threshold. Return true if any
+   * junction point is removed.
+   */
+  bool ValidateJunctions();
+
   void LoadConvergedSnakes(const std::string &filename) {
     this->LoadSnakes(filename, converged_snakes_);
+    junction_index_.Clear();
   }
 
   void LoadGroundTruthSnakes(const std::string &filename) {
@@ -188,7 +305,10 @@ class Multisnake : public QObject {
   Snake * PopLastInitialSnake();
 
   void AddInitialSnake(Snake *s) {initial_snakes_.push_back(s);}
-  void AddConvergedSnake(Snake *s) {converged_snakes_.push_back(s);}
+  void AddConvergedSnake(Snake *s) {
+    converged_snakes_.push_back(s);
+    converged_index_.AddSnake(s);
+  }
   void AddSubsnakesToInitialSnakes(Snake *s);
 
   void ComputeGroundTruthLocalSNRs(int radial_near, int radial_far,
@@ -268,19 +388,68 @@ class Multisnake : public QObject {
                         const std::string &value);
 
 
+  /*
+   * Evolve the initial snakes one at a time until none is left, and
+   * count each of them in ncompleted.
+   */
+  void DeformSnakesSerially(unsigned &ncompleted);
+
+  /*
+   * Evolve the initial snakes that fit in a tile concurrently, tile
+   * color by tile color, and leave the others in initial_snakes_.
+   */
+  void DeformSnakesInTiles(unsigned &ncompleted);
+
+  /*
+   * Evolve the initial snakes in rounds of speculative evolutions, until
+   * none is left.
+   */
+  void DeformSnakesOptimistically(unsigned &ncompleted);
+
+  /*
+   * Evolve the initial snakes speculatively on all threads, until none
+   * is left.
+   */
+  void DeformSnakesConcurrently(unsigned &ncompleted);
+
+  /*
+   * Evolve the initial snakes in the order of the serial loop, with the
+   * snakes next in line evolved ahead of time, until none is left.
+   */
+  void DeformSnakesDeterministically(unsigned &ncompleted);
+
+  /*
+   * Fill solvers with one solver bank per worker thread, starting
+   * with solver_bank_. The others share its settings and factorization
+   * cache, and are to be deleted by the caller.
+   */
+  void CreateSolverBanks(std::vector<SolverBank *> &solvers) const;
+
+  /*
+   * Sort snakes by length bin, then by the Morton key of their centroids.
+   */
+  void SortSnakesByLocality(SnakeContainer &snakes) const;
+
   void CutSnakes(SnakeContainer &seg);
   void ClearSnakeContainer(SnakeContainer &snakes);
 
+  typedef std::unordered_set<Snake *> LinkedSnakeSet;
+
   void LinkSegments(SnakeContainer &seg);
-  void LinkFromSegment(Snake *s, SnakeContainer &seg,
-                       SnakeSet &log, PointContainer &pc, bool &is_open);
+
+  /*
+   * Link the segments chained to s through the tip links into pc. The
+   * linked segments other than s are deleted and added to linked.
+   */
+  void LinkFromSegment(Snake *s, LinkedSnakeSet &linked,
+                       PointContainer &pc, bool &is_open);
   void LinkFromSegmentTip(SnakeTip *neighbor, PointContainer &pc,
-                          bool &is_open, SnakeContainer &seg,
-                          SnakeSet &log, bool from_head);
+                          bool &is_open, LinkedSnakeSet &linked,
+                          bool from_head);
   void AddToPointContainer(PointContainer &pc, Snake *s,
                            bool is_head, bool from_head);
   void UpdateJunctions();
-  unsigned GetNumberOfSnakesCloseToPoint(const PointType &p);
+  void IndexJunctionSnakes();
 
   void LoadSnakes(const std::string &filename, SnakeContainer &snakes);
   void LoadJFilamentSnakes(const std::string &filename,
@@ -291,8 +460,15 @@ class Multisnake : public QObject {
 
   void ComputeErrorFromSnakesToComparingSnakes(DataContainer &errors) const;
   void ComputeErrorFromComparingSnakesToSnakes(DataContainer &errors) const;
-  double ComputeShortestDistance(const PointType &p,
-                                 const SnakeContainer &snakes) const;
+
+  /*
+   * Append to distances the distance from each vertex of snakes, in
+   * order, to the closest vertex of targets. The targets are put in a
+   * k-d tree once and the vertices are queried in parallel.
+   */
+  void ComputeShortestDistances(const SnakeContainer &snakes,
+                                const SnakeContainer &targets,
+                                DataContainer &distances) const;
 
 
   void ComputeRTheta(const PointType &point1, const PointType &point2,
@@ -320,9 +496,12 @@ class Multisnake : public QObject {
   VectorInterpolatorType::Pointer vector_interpolator_;
   TransformType::Pointer transform_;
   SolverBank *solver_bank_;
+  SnakeParameters snake_parameters_;
 
   SnakeContainer initial_snakes_;
   SnakeContainer converged_snakes_;
+  SnakeIndex converged_index_;
+  SnakeIndex junction_index_;
   SnakeContainer comparing_snakes1_;
   SnakeContainer comparing_snakes2_;
 
@@ -366,6 +545,13 @@ class Multisnake : public QObject {
    */
   unsigned dim_;
 
+  unsigned number_of_threads_;
+  double tile_size_;
+  unsigned number_of_commits_;
+  unsigned number_of_retries_;
+  unsigned number_of_evolutions_;
+  double length_bin_;
+
   DISALLOW_COPY_AND_ASSIGN(Multisnake);
 };
 
@@ -30,39 +30,41 @@ ParametersDialog::ParametersDialog(QWidget *parent) : QDialog(parent) {
 }
 
 void ParametersDialog::SetCurrentParameters(Multisnake *ms) {
+  const SnakeParameters &p = ms->snake_parameters();
   intensity_scaling_edit_->setText(QString::number(ms->intensity_scaling()));
   sigma_edit_->setText(QString::number(ms->sigma()));
   ridge_threshold_edit_->setText(QString::number(ms->ridge_threshold()));
   foreground_edit_->setText(QString::number(ms->foreground()));
   background_edit_->setText(QString::number(ms->background()));
-  spacing_edit_->setText(QString::number(Snake::desired_spacing()));
-  min_snake_length_edit_->setText(QString::number(Snake::minimum_length()));
-  max_iterations_edit_->setText(QString::number(Snake::max_iterations()));
+  spacing_edit_->setText(QString::number(p.desired_spacing()));
+  min_snake_length_edit_->setText(QString::number(p.minimum_length()));
+  max_iterations_edit_->setText(QString::number(p.max_iterations()));
   change_threshold_edit_->setText(
-      QString::number(Snake::change_threshold()));
-  check_period_edit_->setText(QString::number(Snake::check_period()));
+      QString::number(p.change_threshold()));
+  check_period_edit_->setText(QString::number(p.check_period()));
   iterations_per_press_edit_->setText(
-      QString::number(Snake::iterations_per_press()));
+      QString::number(p.iterations_per_press()));
   alpha_edit_->setText(QString::number(ms->solver_bank()->alpha()));
   beta_edit_->setText(QString::number(ms->solver_bank()->beta()));
   gamma_edit_->setText(QString::number(ms->solver_bank()->gamma()));
-  external_factor_edit_->setText(QString::number(Snake::external_factor()));
-  stretch_factor_edit_->setText(QString::number(Snake::stretch_factor()));
+  external_factor_edit_->setText(QString::number(p.external_factor()));
+  stretch_factor_edit_->setText(QString::number(p.stretch_factor()));
   number_of_sectors_edit_->setText(
-      QString::number(Snake::number_of_sectors()));
-  radial_near_edit_->setText(QString::number(Snake::radial_near()));
-  radial_far_edit_->setText(QString::number(Snake::radial_far()));
-  z_spacing_edit_->setText(QString::number(Snake::z_spacing()));
-  delta_edit_->setText(QString::number(Snake::delta()));
+      QString::number(p.number_of_sectors()));
+  radial_near_edit_->setText(QString::number(p.radial_near()));
+  radial_far_edit_->setText(QString::number(p.radial_far()));
+  z_spacing_edit_->setText(QString::number(p.z_spacing()));
+  delta_edit_->setText(QString::number(p.delta()));
   overlap_threshold_edit_->setText(
-      QString::number(Snake::overlap_threshold()));
+      QString::number(p.overlap_threshold()));
   grouping_distance_threshold_edit_->setText(
-      QString::number(Snake::grouping_distance_threshold()));
-  grouping_delta_edit_->setText(QString::number(Snake::grouping_delta()));
+      QString::number(p.grouping_distance_threshold()));
+  grouping_delta_edit_->setText(QString::number(p.grouping_delta()));
   direction_threshold_edit_->setText(
-      QString::number(Snake::direction_threshold()));
+      QString::number(p.direction_threshold()));
   initialize_z_check_->setChecked(ms->initialize_z());
-  damp_z_check_->setChecked(Snake::damp_z());
+  damp_z_check_->setChecked(p.damp_z());
+  adaptive_step_check_->setChecked(p.adaptive_step());
 }
 
 void ParametersDialog::EnableOKButton() {
@@ -105,6 +107,8 @@ QGroupBox * ParametersDialog::CreateSnakeGroup() {
   initialize_z_check_->setChecked(false);
   damp_z_check_ = new QCheckBox(tr("Damp z"));
   damp_z_check_->setChecked(false);
+  adaptive_step_check_ = new QCheckBox(tr("Adaptive step"));
+  adaptive_step_check_->setChecked(false);
 
   connect(intensity_scaling_edit_, SIGNAL(textEdited(const QString &)),
           this, SLOT(EnableOKButton()));
@@ -161,6 +165,8 @@ QGroupBox * ParametersDialog::CreateSnakeGroup() {
           this, SLOT(EnableOKButton()));
   connect(damp_z_check_, SIGNAL(stateChanged(int)),
           this, SLOT(EnableOKButton()));
+  connect(adaptive_step_check_, SIGNAL(stateChanged(int)),
+          this, SLOT(EnableOKButton()));
 
   QFormLayout *layout_left  = new QFormLayout;
   layout_left->addRow(tr("Intensity Scaling (0 for automatic)"),
@@ -181,6 +187,7 @@ QGroupBox * ParametersDialog::CreateSnakeGroup() {
                       iterations_per_press_edit_);
   layout_left->addRow(tr(""), initialize_z_check_);
   layout_left->addRow(tr(""), damp_z_check_);
+  layout_left->addRow(tr(""), adaptive_step_check_);
 
   QFormLayout *layout_right  = new QFormLayout;
   layout_right->addRow(tr("Alpha"), alpha_edit_);
@@ -78,6 +78,7 @@ class ParametersDialog : public QDialog {
     return direction_threshold_edit_->text().toDouble();
   }
   bool DampZ() {return damp_z_check_->isChecked();}
+  bool AdaptiveStep() {return adaptive_step_check_->isChecked();}
 
   void SetCurrentParameters(Multisnake *ms);
 
@@ -119,6 +120,7 @@ class ParametersDialog : public QDialog {
 
   QCheckBox *initialize_z_check_;
   QCheckBox *damp_z_check_;
+  QCheckBox *adaptive_step_check_;
 
   DISALLOW_COPY_AND_ASSIGN(ParametersDialog);
 };
@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file implements the direct solver for the snake stiffness systems
+ * in SOAX.
+ */
+
+#include "./pentadiagonal_solver.h"
+
+namespace soax {
+
+PentadiagonalSolver::PentadiagonalSolver(unsigned order, bool open,
+                                         double alpha, double beta,
+                                         double gamma) :
+    order_(order), open_(open), alpha_(alpha), beta_(beta), gamma_(gamma),
+    band_size_(open ? order : order - 2),
+    d_(order, 0.0), l1_(order, 0.0), l2_(order, 0.0) {
+  if (!open_) {
+    e0_.assign(band_size_, 0.0);
+    e1_.assign(order_ - 1, 0.0);
+  }
+  this->Factor();
+}
+
+/*
+ * The matrix entries are the same as the ones filled by
+ * SolverBank::FillMatrixOpen and SolverBank::FillMatrixClosed.
+ */
+void PentadiagonalSolver::Factor() {
+  const unsigned n = order_;
+  const unsigned m = band_size_;
+  const double diag0 = 2 * alpha_ + 6 * beta_ + gamma_;
+  const double diag1 = -alpha_ - 4 * beta_;
+
+  // main and +1/-1 diagonals of the matrix; off[i] = A(i, i-1)
+  DataContainer diag(n, diag0), off(n, diag1);
+  if (open_) {
+    diag[0] = diag[n - 1] = alpha_ + beta_ + gamma_;
+    diag[1] = diag[n - 2] = 2 * alpha_ + 5 * beta_ + gamma_;
+    off[0] = 0.0;
+    off[1] = off[n - 1] = -alpha_ - 2 * beta_;
+  }
+
+  for (unsigned i = 0; i < m; ++i) {
+    if (i >= 2)
+      l2_[i] = beta_ / d_[i - 2];
+    if (i >= 1) {
+      double a = off[i];
+      if (i >= 2)
+        a -= l2_[i] * l1_[i - 1] * d_[i - 2];
+      l1_[i] = a / d_[i - 1];
+    }
+
+    double di = diag[i];
+    if (i >= 1)
+      di -= l1_[i] * l1_[i] * d_[i - 1];
+    if (i >= 2)
+      di -= l2_[i] * l2_[i] * d_[i - 2];
+    d_[i] = di;
+  }
+
+  if (open_) return;
+
+  // The wrap-around entries only fill in the last two rows of L.
+  for (unsigned k = 0; k < m; ++k) {
+    double a0 = this->GetClosedMatrixValue(n - 2, k);
+    double a1 = this->GetClosedMatrixValue(n - 1, k);
+    if (k >= 1) {
+      a0 -= e0_[k - 1] * l1_[k] * d_[k - 1];
+      a1 -= e1_[k - 1] * l1_[k] * d_[k - 1];
+    }
+    if (k >= 2) {
+      a0 -= e0_[k - 2] * l2_[k] * d_[k - 2];
+      a1 -= e1_[k - 2] * l2_[k] * d_[k - 2];
+    }
+    e0_[k] = a0 / d_[k];
+    e1_[k] = a1 / d_[k];
+  }
+
+  double d0 = diag0;
+  double a10 = diag1;
+  for (unsigned k = 0; k < m; ++k) {
+    d0 -= e0_[k] * e0_[k] * d_[k];
+    a10 -= e1_[k] * e0_[k] * d_[k];
+  }
+  d_[n - 2] = d0;
+  e1_[n - 2] = a10 / d0;
+
+  double d1 = diag0;
+  for (unsigned k = 0; k < n - 1; ++k)
+    d1 -= e1_[k] * e1_[k] * d_[k];
+  d_[n - 1] = d1;
+}
+
+std::size_t PentadiagonalSolver::GetMemorySize() const {
+  return sizeof(*this) + sizeof(double) *
+      (d_.capacity() + l1_.capacity() + l2_.capacity() +
+       e0_.capacity() + e1_.capacity());
+}
+
+double PentadiagonalSolver::GetClosedMatrixValue(unsigned i,
+                                                 unsigned j) const {
+  unsigned dist = i > j ? i - j : j - i;
+  if (order_ - dist < dist)
+    dist = order_ - dist;
+
+  if (dist == 0)
+    return 2 * alpha_ + 6 * beta_ + gamma_;
+  else if (dist == 1)
+    return -alpha_ - 4 * beta_;
+  else if (dist == 2)
+    return beta_;
+  else
+    return 0.0;
+}
+
+void PentadiagonalSolver::Solve(VectorContainer &vectors, unsigned dim,
+                                VertexBuffer &points) const {
+  const unsigned n = order_;
+  const unsigned m = band_size_;
+
+  // L z = b
+  for (unsigned i = 1; i < m; ++i) {
+    vectors[i] -= l1_[i] * vectors[i - 1];
+    if (i >= 2)
+      vectors[i] -= l2_[i] * vectors[i - 2];
+  }
+  if (!open_) {
+    for (unsigned k = 0; k < m; ++k) {
+      vectors[n - 2] -= e0_[k] * vectors[k];
+      vectors[n - 1] -= e1_[k] * vectors[k];
+    }
+    vectors[n - 1] -= e1_[n - 2] * vectors[n - 2];
+  }
+
+  // D y = z
+  for (unsigned i = 0; i < n; ++i)
+    vectors[i] /= d_[i];
+
+  // L^T x = y, writing each solution as soon as it is final
+  if (!open_) {
+    vectors[n - 2] -= e1_[n - 2] * vectors[n - 1];
+    this->CopyToPoint(vectors[n - 1], dim, points, n - 1);
+    this->CopyToPoint(vectors[n - 2], dim, points, n - 2);
+  }
+  for (unsigned i = m; i-- > 0;) {
+    if (i + 1 < m)
+      vectors[i] -= l1_[i + 1] * vectors[i + 1];
+    if (i + 2 < m)
+      vectors[i] -= l2_[i + 2] * vectors[i + 2];
+    if (!open_)
+      vectors[i] -= e0_[i] * vectors[n - 2] + e1_[i] * vectors[n - 1];
+    this->CopyToPoint(vectors[i], dim, points, i);
+  }
+}
+
+void PentadiagonalSolver::SolveBatch(double *data, unsigned width) const {
+  const unsigned n = order_;
+  const unsigned m = band_size_;
+
+  // L z = b
+  for (unsigned i = 1; i < m; ++i) {
+    double *row = data + i * width;
+    const double *row1 = row - width;
+    const double l1 = l1_[i];
+    for (unsigned j = 0; j < width; ++j)
+      row[j] -= l1 * row1[j];
+    if (i >= 2) {
+      const double *row2 = row1 - width;
+      const double l2 = l2_[i];
+      for (unsigned j = 0; j < width; ++j)
+        row[j] -= l2 * row2[j];
+    }
+  }
+  if (!open_) {
+    double *row0 = data + (n - 2) * width;
+    double *row1 = data + (n - 1) * width;
+    for (unsigned k = 0; k < m; ++k) {
+      const double *rowk = data + k * width;
+      const double e0 = e0_[k];
+      const double e1 = e1_[k];
+      for (unsigned j = 0; j < width; ++j) {
+        row0[j] -= e0 * rowk[j];
+        row1[j] -= e1 * rowk[j];
+      }
+    }
+    const double e = e1_[n - 2];
+    for (unsigned j = 0; j < width; ++j)
+      row1[j] -= e * row0[j];
+  }
+
+  // D y = z
+  for (unsigned i = 0; i < n; ++i) {
+    double *row = data + i * width;
+    const double d = d_[i];
+    for (unsigned j = 0; j < width; ++j)
+      row[j] /= d;
+  }
+
+  // L^T x = y
+  const double *last0 = data + (n - 2) * width;
+  const double *last1 = data + (n - 1) * width;
+  if (!open_) {
+    double *row0 = data + (n - 2) * width;
+    const double e = e1_[n - 2];
+    for (unsigned j = 0; j < width; ++j)
+      row0[j] -= e * last1[j];
+  }
+  for (unsigned i = m; i-- > 0;) {
+    double *row = data + i * width;
+    if (i + 1 < m) {
+      const double l1 = l1_[i + 1];
+      const double *next = row + width;
+      for (unsigned j = 0; j < width; ++j)
+        row[j] -= l1 * next[j];
+    }
+    if (i + 2 < m) {
+      const double l2 = l2_[i + 2];
+      const double *next = row + 2 * width;
+      for (unsigned j = 0; j < width; ++j)
+        row[j] -= l2 * next[j];
+    }
+    if (!open_) {
+      const double e0 = e0_[i];
+      const double e1 = e1_[i];
+      for (unsigned j = 0; j < width; ++j)
+        row[j] -= e0 * last0[j] + e1 * last1[j];
+    }
+  }
+}
+
+}  // namespace soax
@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file defines the direct solver for the snake stiffness systems
+ * in SOAX.
+ */
+
+
+#ifndef PENTADIAGONAL_SOLVER_H_
+#define PENTADIAGONAL_SOLVER_H_
+
+#include <cstddef>
+#include "./global.h"
+#include "./vertex_buffer.h"
+
+namespace soax {
+
+/*
+ * Direct solver for the symmetric positive definite pentadiagonal
+ * system (A + gamma * I) x = b of a snake. The matrix is factored once
+ * as L * D * L^T in the constructor, after which each solve is a
+ * forward and a back substitution in O(order).
+ *
+ * For a closed snake the matrix is cyclic. Its wrap-around entries only
+ * fill in the last two rows of L, which are stored densely, so both the
+ * factorization and the solve remain O(order).
+ */
+class PentadiagonalSolver {
+ public:
+  PentadiagonalSolver(unsigned order, bool open, double alpha, double beta,
+                      double gamma);
+
+  unsigned order() const {return order_;}
+  bool open() const {return open_;}
+  double alpha() const {return alpha_;}
+  double beta() const {return beta_;}
+  double gamma() const {return gamma_;}
+
+  /*
+   * Returns the number of bytes used by this solver.
+   */
+  std::size_t GetMemorySize() const;
+
+  /*
+   * Returns true if this solver was factored from the given
+   * parameters.
+   */
+  bool Matches(double alpha, double beta, double gamma) const {
+    return alpha == alpha_ && beta == beta_ && gamma == gamma_;
+  }
+
+  /*
+   * Solve the systems for all the components of vectors at once. The
+   * vectors are overwritten by the intermediate results, and the first
+   * dim components of the solution are written to points.
+   */
+  void Solve(VectorContainer &vectors, unsigned dim,
+             VertexBuffer &points) const;
+
+  /*
+   * Solve a batch of systems of this order in place. data holds order_
+   * rows of width values each, where row i holds the i-th entry of every
+   * right hand side. Each column gets exactly the same arithmetic as in
+   * Solve, so the results are identical.
+   */
+  void SolveBatch(double *data, unsigned width) const;
+
+ private:
+  void Factor();
+
+  /*
+   * Return the entry (i, j) of the cyclic matrix of a closed snake.
+   */
+  double GetClosedMatrixValue(unsigned i, unsigned j) const;
+
+  static void CopyToPoint(const VectorType &v, unsigned dim,
+                          VertexBuffer &points, unsigned i) {
+    for (unsigned k = 0; k < dim; ++k)
+      points.coordinates(k)[i] = v[k];
+  }
+
+  unsigned order_;
+  bool open_;
+  double alpha_;
+  double beta_;
+  double gamma_;
+
+  /*
+   * Number of leading rows of L that are banded. It is order_ for open
+   * snakes and order_ - 2 for closed ones.
+   */
+  unsigned band_size_;
+
+  /*
+   * Diagonal of D.
+   */
+  DataContainer d_;
+
+  /*
+   * First and second subdiagonals of the unit lower triangular L.
+   * l1_[i] = L(i, i-1) and l2_[i] = L(i, i-2).
+   */
+  DataContainer l1_;
+  DataContainer l2_;
+
+  /*
+   * The last two rows of L of a closed snake. e0_[k] = L(order-2, k) and
+   * e1_[k] = L(order-1, k).
+   */
+  DataContainer e0_;
+  DataContainer e1_;
+
+  DISALLOW_COPY_AND_ASSIGN(PentadiagonalSolver);
+};
+
+}  // namespace soax
+
+#endif  // PENTADIAGONAL_SOLVER_H_
@@ -7,45 +7,30 @@
  */
 
 
+#include <algorithm>
 #include <iomanip>
+#include <map>
 #include "./snake.h"
+#include "./snake_index.h"
 #include "./solver_bank.h"
 #include "./utility.h"
 
 namespace soax {
 
-double Snake::intensity_scaling_ = 0.0;
-unsigned Snake::foreground_ = 65535;
-unsigned Snake::background_ = 0;
-double Snake::desired_spacing_ = 1.0;
-double Snake::minimum_length_ = 10.0;
-unsigned Snake::max_iterations_ = 10000;
-double Snake::change_threshold_ = 0.1;
-unsigned Snake::check_period_ = 100;
-unsigned Snake::iterations_per_press_ = 100;
-double Snake::external_factor_ = 1.0;
-double Snake::stretch_factor_ = 0.2;
-int Snake::number_of_sectors_ = 8;
-int Snake::radial_near_ = 4;
-int Snake::radial_far_ = 8;
-unsigned Snake::delta_ = 4;
-double Snake::overlap_threshold_ = 1.0;
-double Snake::grouping_distance_threshold_ = 4.0;
-unsigned Snake::grouping_delta_ = 8.0;
-double Snake::direction_threshold_ = 2.1;
-bool Snake::damp_z_ = false;
-double Snake::z_spacing_ = 2.88;
 const double Snake::kBoundary = 0.5;
+const unsigned Snake::kMaxStepLevel = 3;
+const unsigned Snake::kStepStreak = 3;
 
 
-Snake::Snake(const PointContainer &points, bool is_open, bool is_grouping,
-             ImageType::Pointer image,
+Snake::Snake(const PointContainer &points,
+             const SnakeParameters *parameters,
+             bool is_open, bool is_grouping, ImageType::Pointer image,
              VectorImageType::Pointer external_force,
              InterpolatorType::Pointer interpolator,
              VectorInterpolatorType::Pointer vector_interpolator,
              TransformType::Pointer transform) :
-    open_(is_open), grouping_(is_grouping) {
-  vertices_ = points;
+    parameters_(parameters), open_(is_open), grouping_(is_grouping) {
+  vertices_.Assign(points);
   image_ = image;
   external_force_ = external_force;
   interpolator_ = interpolator;
@@ -59,6 +44,14 @@ Snake::Snake(const PointContainer &points, bool is_open, bool is_grouping,
   spacing_ = 0.0;
   intensity_ = 0.0;
   iterations_ = 0;
+  step_level_ = 0;
+  step_streak_ = 0;
+  last_velocity_ = kPlusInfinity;
+  solved_ = false;
+  solve_displacement_ = 0.0;
+  window_iterations_ = 0;
+  recent_displacement_sum_ = 0.0;
+  recent_count_ = 0;
   head_tangent_.Fill(0);
   tail_tangent_.Fill(0);
   fixed_head_.Fill(-1.0);
@@ -67,6 +60,46 @@ Snake::Snake(const PointContainer &points, bool is_open, bool is_grouping,
   tail_hooked_snake_ = NULL;
   head_hooked_index_ = 0;
   tail_hooked_index_ = 0;
+  head_clearance_.version = 0;
+  tail_clearance_.version = 0;
+  this->ResetConvergenceTracking();
+}
+
+Snake *Snake::Clone() const {
+  Snake *s = new Snake(PointContainer(), parameters_, open_, grouping_,
+                       image_, external_force_, interpolator_,
+                       vector_interpolator_, transform_);
+  s->vertices_ = vertices_;
+  s->solved_ = solved_;
+  s->solve_displacement_ = solve_displacement_;
+  s->window_vertices_ = window_vertices_;
+  s->window_iterations_ = window_iterations_;
+  s->recent_displacements_ = recent_displacements_;
+  s->recent_displacement_sum_ = recent_displacement_sum_;
+  s->recent_count_ = recent_count_;
+  s->viable_ = viable_;
+  s->initial_state_ = initial_state_;
+  s->converged_ = converged_;
+  s->final_ = final_;
+  s->length_ = length_;
+  s->spacing_ = spacing_;
+  s->intensity_ = intensity_;
+  s->iterations_ = iterations_;
+  s->step_level_ = step_level_;
+  s->step_streak_ = step_streak_;
+  s->last_velocity_ = last_velocity_;
+  s->head_tangent_ = head_tangent_;
+  s->tail_tangent_ = tail_tangent_;
+  s->fixed_head_ = fixed_head_;
+  s->fixed_tail_ = fixed_tail_;
+  s->head_hooked_snake_ = head_hooked_snake_;
+  s->tail_hooked_snake_ = tail_hooked_snake_;
+  s->head_hooked_index_ = head_hooked_index_;
+  s->tail_hooked_index_ = tail_hooked_index_;
+  s->head_clearance_ = head_clearance_;
+  s->tail_clearance_ = tail_clearance_;
+  s->junction_indices_ = junction_indices_;
+  return s;
 }
 
 void Snake::Resample() {
@@ -78,48 +111,59 @@ void Snake::Resample() {
     return;
   }
 
-  double spacing = initial_state_ ? 0.25 : desired_spacing_;
+  double spacing = initial_state_ ? 0.25 : parameters_->desired_spacing();
 
-  PairContainer sums[kDimension];
-  this->UpdateLength(sums);
+  DataContainer &lengths = GetWorkspace().lengths;
+  this->UpdateLength(lengths);
   if (length_ < spacing) {
     viable_ = false;
     return;
   }
   unsigned new_size = this->ComputeNewSize(spacing);
   spacing_ = length_ / (new_size - 1);
-  this->InterpolateVertices(sums, new_size);
+  this->InterpolateVertices(lengths, new_size);
+  if (solved_)
+    this->TrackDisplacement();
+  solved_ = false;
 
   if (final_) {
-    viable_ = length_ > minimum_length_;
+    viable_ = length_ > parameters_->minimum_length();
   } else if (grouping_) {
-    viable_ = length_ > grouping_distance_threshold_;
+    viable_ = length_ > parameters_->grouping_distance_threshold();
   } else {
     viable_ = vertices_.size() >= kMinimumEvolvingSize;
   }
 
   // if (final_ || !open_) {
-  //   viable_ = length_ > minimum_length_;
+  //   viable_ = length_ > minimum_length;
   // } else if (grouping_) {
-  //   viable_ = length_ > grouping_distance_threshold_;
+  //   viable_ = length_ > grouping_distance_threshold;
   // } else if (!converged_) {
   //   viable_ = vertices_.size() >= kMinimumEvolvingSize;
   // }
 }
 
-void Snake::UpdateLength(PairContainer *sums) {
-  double current_length = 0.0;
-  for (unsigned k = 0; k < kDimension; ++k) {
-    sums[k].push_back(std::make_pair(current_length, vertices_.front()[k]));
-  }
+void Snake::UpdateLength(DataContainer &lengths) {
+  length_ = Snake::ComputeCumulativeLengths(vertices_, lengths);
+}
 
-  for (unsigned i = 1; i < vertices_.size(); ++i) {
-    current_length += vertices_[i].EuclideanDistanceTo(vertices_[i-1]);
-    for (unsigned k = 0; k < kDimension; ++k) {
-      sums[k].push_back(std::make_pair(current_length, vertices_.at(i)[k]));
-    }
+double Snake::ComputeCumulativeLengths(const VertexBuffer &vertices,
+                                       DataContainer &lengths) {
+  const double *x = vertices.coordinates(0);
+  const double *y = vertices.coordinates(1);
+  const double *z = vertices.coordinates(2);
+  lengths.resize(vertices.size());
+  double current_length = 0.0;
+  lengths[0] = current_length;
+
+  for (unsigned i = 1; i < vertices.size(); ++i) {
+    const double dx = x[i] - x[i-1];
+    const double dy = y[i] - y[i-1];
+    const double dz = z[i] - z[i-1];
+    current_length += std::sqrt(dx * dx + dy * dy + dz * dz);
+    lengths[i] = current_length;
   }
-  length_ = current_length;
+  return current_length;
 }
 
 double Snake::ComputeNewSize(double spacing) const {
@@ -132,40 +176,54 @@ double Snake::ComputeNewSize(double spacing) const {
 }
 
 
-void Snake::InterpolateVertices(const PairContainer *sums,
+void Snake::InterpolateVertices(const DataContainer &lengths,
                                 unsigned new_size) {
-  PointContainer new_vertices(new_size);
+  VertexBuffer &new_vertices = GetWorkspace().vertices;
+  new_vertices.Clear();
+  new_vertices.Resize(new_size);
 
-  new_vertices.front() = vertices_.front();
-  new_vertices.back() = vertices_.back();
+  new_vertices.SetPoint(0, vertices_.GetHead());
+  new_vertices.SetPoint(new_size - 1, vertices_.GetTail());
 
+  // The arc lengths of the new vertices increase with i, so the segment
+  // [j-1, j] containing each of them is found by advancing j only.
+  const unsigned last = vertices_.size() - 1;
+  unsigned j = 1;
   for (unsigned i = 1; i < new_size-1; ++i) {
+    const double s = spacing_ * i;
+    while (j < last && lengths[j] < s)
+      ++j;
     for (unsigned k = 0; k < kDimension; ++k) {
-      PairContainer::const_iterator it1, it2;
-      it1 = lower_bound(sums[k].begin(), sums[k].end(),
-                        std::make_pair(spacing_*i, 0.0));
-      it2 = it1--;
-      new_vertices.at(i)[k] = it1->second + (it2->second - it1->second) *
-                              (spacing_*i - it1->first) / (it2->first - it1->first);
+      const double *c = vertices_.coordinates(k);
+      new_vertices.coordinates(k)[i] = c[j-1] + (c[j] - c[j-1]) *
+          (s - lengths[j-1]) / (lengths[j] - lengths[j-1]);
     }
   }
-  vertices_ = new_vertices;
+  vertices_.Swap(new_vertices);
 }
 
 
-void Snake::Evolve(SolverBank *solver, const SnakeContainer &converged_snakes,
+void Snake::Evolve(SolverBank *solver, const SnakeIndex &converged_snakes,
                    unsigned max_iter, unsigned dim) {
+  this->EvolveIterations(solver, converged_snakes, max_iter, dim);
+  this->CheckBodyOverlap(converged_snakes);
+}
+
+bool Snake::EvolveIterations(SolverBank *solver,
+                             const SnakeIndex &converged_snakes,
+                             unsigned max_iter, unsigned dim) {
   unsigned iter = 0;
+  const bool adaptive = parameters_->adaptive_step() && solver->direct();
 
   while (iter <= max_iter) {
-    if (iterations_ >= max_iterations_)  {
+    if (iterations_ >= parameters_->max_iterations())  {
       // std::cout << this << " reaches maximum iterations." << std::endl;
       converged_ = true;
       break;
     }
 
-    if (!(iterations_ % check_period_)) {
-      if (this->IsConverged()) break;
+    if (this->IsConverged()) break;
+    if (!(iterations_ % parameters_->check_period())) {
       if (iterations_ && initial_state_)
         initial_state_ = false;
     }
@@ -176,51 +234,191 @@ void Snake::Evolve(SolverBank *solver, const SnakeContainer &converged_snakes,
     if (!viable_)  break;
     this->HandleTailOverlap(converged_snakes);
     if (!viable_)  break;
-    this->IterateOnce(solver, dim);
+    if (adaptive)
+      this->IterateAdaptively(solver, dim);
+    else
+      this->IterateOnce(solver, dim);
     this->Resample();
     iter++;
     if (!viable_)  break;
   }
-  this->CheckBodyOverlap(converged_snakes);
+  return converged_ || !viable_;
+}
+
+Snake::Workspace &Snake::GetWorkspace() {
+  static thread_local Workspace workspace;
+  return workspace;
 }
 
 bool Snake::IsConverged() {
-  if (vertices_.size() != last_vertices_.size()) {
-    last_vertices_ = vertices_;
-    return false;
+  // No vertex can have moved more than the sum of the maximum
+  // displacements of the last check_period iterations.
+  bool settled = recent_count_ >= parameters_->check_period() &&
+                 recent_displacement_sum_ <= parameters_->change_threshold();
+
+  if (!settled && window_iterations_ >= parameters_->check_period()) {
+    settled = this->StaysWithinWindow();
+    if (!settled)
+      this->RestartConvergenceWindow();
   }
-  for (unsigned i = 0; i < vertices_.size(); ++i) {
-    double d = vertices_.at(i).EuclideanDistanceTo(last_vertices_.at(i));
 
-    if (d > change_threshold_) {
-      last_vertices_ = vertices_;
-      return false;
+  if (settled)
+    converged_ = true;
+  return settled;
+}
+
+bool Snake::StaysWithinWindow() const {
+  const VertexBuffer &start = window_vertices_;
+  if (start.size() < 2) return false;
+  DataContainer &start_lengths = GetWorkspace().window_lengths;
+  const double start_length = Snake::ComputeCumulativeLengths(
+      start, start_lengths);
+  const double threshold = parameters_->change_threshold();
+  const double squared_threshold = threshold * threshold;
+
+  // The vertices are evenly spaced, so the i-th one is compared with the
+  // point at the same fraction of the length of the snake at the start
+  // of the window.
+  const unsigned last = start.size() - 1;
+  const double scale = vertices_.size() > 1 ?
+                       start_length / (vertices_.size() - 1) : 0.0;
+  unsigned j = 1;
+  for (unsigned i = 0; i < vertices_.size(); ++i) {
+    const double s = scale * i;
+    while (j < last && start_lengths[j] < s)
+      ++j;
+    const double segment = start_lengths[j] - start_lengths[j-1];
+    double t = segment > 0.0 ? (s - start_lengths[j-1]) / segment : 0.0;
+    t = std::min(std::max(t, 0.0), 1.0);
+
+    double squared_displacement = 0.0;
+    for (unsigned k = 0; k < kDimension; ++k) {
+      const double *p = start.coordinates(k);
+      const double delta = vertices_.coordinates(k)[i] -
+                           (p[j-1] + (p[j] - p[j-1]) * t);
+      squared_displacement += delta * delta;
     }
+    if (squared_displacement > squared_threshold)
+      return false;
   }
-  converged_ = true;
   return true;
 }
 
+void Snake::TrackDisplacement() {
+  const unsigned period = parameters_->check_period();
+  if (recent_displacements_.size() != period) {
+    recent_displacements_.assign(period, 0.0);
+    recent_displacement_sum_ = 0.0;
+    recent_count_ = 0;
+  }
+  double &slot = recent_displacements_[recent_count_ % period];
+  recent_displacement_sum_ += solve_displacement_ - slot;
+  slot = solve_displacement_;
+  recent_count_++;
+  window_iterations_++;
+}
+
+void Snake::RestartConvergenceWindow() {
+  window_vertices_ = vertices_;
+  window_iterations_ = 0;
+}
+
+void Snake::ForgetRecentDisplacements() {
+  std::fill(recent_displacements_.begin(), recent_displacements_.end(), 0.0);
+  recent_displacement_sum_ = 0.0;
+  recent_count_ = 0;
+}
+
+void Snake::ResetConvergenceTracking() {
+  this->RestartConvergenceWindow();
+  this->ForgetRecentDisplacements();
+}
+
 void Snake::CheckSelfIntersection() {
   if (!open_) return;
-  const int min_loop_size = 20;
-  if (vertices_.size() <= min_loop_size) return;
-
-  for (PointIterator it1 = vertices_.begin();
-       it1 != vertices_.end() - min_loop_size; ++it1) {
-    for (PointIterator it2 = it1 + min_loop_size;
-         it2 != vertices_.end(); ++it2) {
-      double d = (*it1).EuclideanDistanceTo(*it2);
-      if (d < 1.0 && !this->TipsStopAtSameLocation()) {
-        this->TryInitializeFromPart(vertices_.begin(), it1, true);
-        this->TryInitializeFromPart(it2, vertices_.end(), true);
-        this->TryInitializeFromPart(it1, it2, false);
-        // std::cout << "\nSelf-intersection detected!" << std::endl;
-        viable_ = false;
-        return;
+  const unsigned min_loop_size = 20;
+  const unsigned size = vertices_.size();
+  if (size <= min_loop_size) return;
+  if (this->TipsStopAtSameLocation()) return;
+
+  unsigned i, j;
+  if (this->FindCloseVertexPair(min_loop_size, i, j)) {
+    this->TryInitializeFromPart(0, i, true);
+    this->TryInitializeFromPart(j, size, true);
+    this->TryInitializeFromPart(i, j, false);
+    // std::cout << "\nSelf-intersection detected!" << std::endl;
+    viable_ = false;
+  }
+}
+
+bool Snake::FindCloseVertexPair(unsigned min_gap, unsigned &i,
+                                unsigned &j) const {
+  typedef std::vector<std::pair<uint64_t, unsigned> > CellContainer;
+  const unsigned size = vertices_.size();
+  const double *x = vertices_.coordinates(0);
+  const double *y = vertices_.coordinates(1);
+  const double *z = vertices_.coordinates(2);
+
+  CellContainer &cells = GetWorkspace().cells;
+  cells.resize(size);
+  for (unsigned n = 0; n < size; ++n) {
+    cells[n] = std::make_pair(SnakeIndex::ComputeKey(std::floor(x[n]),
+                                                     std::floor(y[n]),
+                                                     std::floor(z[n])), n);
+  }
+  std::sort(cells.begin(), cells.end());
+
+  // Vertices less than one unit apart lie in the same or adjacent unit
+  // cells. Each pair of adjacent cells is visited once, from the one
+  // with the lower offset.
+  i = j = size;
+  unsigned begin = 0;
+  while (begin < size) {
+    unsigned end = begin + 1;
+    while (end < size && cells[end].first == cells[begin].first) ++end;
+    const unsigned v = cells[begin].second;
+    const int64_t cx = std::floor(x[v]);
+    const int64_t cy = std::floor(y[v]);
+    const int64_t cz = std::floor(z[v]);
+
+    for (int dx = 0; dx <= 1; ++dx) {
+      for (int dy = dx ? -1 : 0; dy <= 1; ++dy) {
+        for (int dz = (dx || dy) ? -1 : 0; dz <= 1; ++dz) {
+          const bool same_cell = !dx && !dy && !dz;
+          CellContainer::const_iterator first = cells.begin() + begin;
+          CellContainer::const_iterator last = cells.begin() + end;
+          if (!same_cell) {
+            const std::pair<uint64_t, unsigned> key(
+                SnakeIndex::ComputeKey(cx + dx, cy + dy, cz + dz), 0);
+            first = std::lower_bound(cells.begin(), cells.end(), key);
+            last = first;
+            while (last != cells.end() && last->first == key.first) ++last;
+          }
+
+          for (unsigned a = begin; a < end; ++a) {
+            const unsigned va = cells[a].second;
+            CellContainer::const_iterator b = same_cell ?
+                cells.begin() + a + 1 : first;
+            for (; b != last; ++b) {
+              const unsigned lower = std::min(va, b->second);
+              const unsigned upper = std::max(va, b->second);
+              if (upper - lower < min_gap) continue;
+              if (lower > i || (lower == i && upper >= j)) continue;
+              const double ex = x[va] - x[b->second];
+              const double ey = y[va] - y[b->second];
+              const double ez = z[va] - z[b->second];
+              if (ex * ex + ey * ey + ez * ez < 1.0) {
+                i = lower;
+                j = upper;
+              }
+            }
+          }
+        }
       }
     }
+    begin = end;
   }
+  return i != size;
 }
 
 bool Snake::TipsStopAtSameLocation() {
@@ -231,10 +429,10 @@ bool Snake::TipsStopAtSameLocation() {
   return false;
 }
 
-void Snake::TryInitializeFromPart(PointIterator it1, PointIterator it2,
+void Snake::TryInitializeFromPart(unsigned start, unsigned end,
                                   bool is_open) {
-  PointContainer points(it1, it2);
-  Snake *s = new Snake(points, is_open, false, image_,
+  PointContainer points = vertices_.GetPoints(start, end);
+  Snake *s = new Snake(points, parameters_, is_open, false, image_,
                        external_force_, interpolator_,
                        vector_interpolator_, transform_);
   s->Resample();
@@ -245,26 +443,30 @@ void Snake::TryInitializeFromPart(PointIterator it1, PointIterator it2,
   }
 }
 
-void Snake::HandleHeadOverlap(const SnakeContainer &converged_snakes) {
-  PointIterator first_detach = vertices_.begin();
-  PointIterator start = vertices_.begin();
+void Snake::HandleHeadOverlap(const SnakeIndex &converged_snakes) {
+  unsigned start = 0;
 
-  if (this->HeadIsFixed())
-    start += static_cast<int>(overlap_threshold_/spacing_);
-  first_detach = this->CheckHeadOverlap(start, converged_snakes);
+  if (this->HeadIsFixed()) {
+    start += std::min(static_cast<unsigned>(
+                          parameters_->overlap_threshold()/spacing_),
+                      vertices_.size());
+  }
+  unsigned first_detach = this->CheckHeadOverlap(start, converged_snakes);
 
   if (first_detach != start) {
-    if (first_detach == vertices_.end()) {
+    if (first_detach == vertices_.size()) {
       // std::cout << "head: total overlap!" << std::endl;
       viable_ = false;
     } else {
-      PointIterator last_touch = first_detach - 1;
-      this->FindHookedSnakeAndIndex(*last_touch, converged_snakes,
+      unsigned last_touch = first_detach - 1;
+      this->FindHookedSnakeAndIndex(vertices_.GetPoint(last_touch),
+                                    converged_snakes,
                                     head_hooked_snake_,
                                     head_hooked_index_);
       fixed_head_ = head_hooked_snake_->GetPoint(head_hooked_index_);
-      vertices_.erase(vertices_.begin(), first_detach);
-      vertices_.push_front(fixed_head_);
+      vertices_.Erase(0, first_detach);
+      vertices_.PushFront(fixed_head_);
+      this->ForgetRecentDisplacements();
       if (!open_)
         open_ = true;
       this->Resample();
@@ -272,27 +474,30 @@ void Snake::HandleHeadOverlap(const SnakeContainer &converged_snakes) {
   }
 }
 
-void Snake::HandleTailOverlap(const SnakeContainer &converged_snakes) {
-  PointIterator first_detach = vertices_.end()-1;
-  PointIterator start = vertices_.end()-1;
+void Snake::HandleTailOverlap(const SnakeIndex &converged_snakes) {
+  unsigned start = vertices_.size() - 1;
 
   if (this->TailIsFixed())
-    start -= static_cast<int>(overlap_threshold_/spacing_);
-  first_detach = this->CheckTailOverlap(start, converged_snakes);
+    start -= std::min(static_cast<unsigned>(
+                          parameters_->overlap_threshold()/spacing_),
+                      start);
+  unsigned first_detach = this->CheckTailOverlap(start, converged_snakes);
 
 
   if (first_detach != start) {
-    if (first_detach == vertices_.begin()) {
+    if (first_detach == 0) {
       // std::cout << "tail: total overlap!" << std::endl;
       viable_ = false;
     } else {
-      PointIterator last_touch = first_detach + 1;
-      this->FindHookedSnakeAndIndex(*last_touch, converged_snakes,
+      unsigned last_touch = first_detach + 1;
+      this->FindHookedSnakeAndIndex(vertices_.GetPoint(last_touch),
+                                    converged_snakes,
                                     tail_hooked_snake_,
                                     tail_hooked_index_);
       fixed_tail_ = tail_hooked_snake_->GetPoint(tail_hooked_index_);
-      vertices_.erase(last_touch, vertices_.end());
-      vertices_.push_back(fixed_tail_);
+      vertices_.Erase(last_touch, vertices_.size());
+      vertices_.PushBack(fixed_tail_);
+      this->ForgetRecentDisplacements();
       if (!open_)
         open_ = true;
       this->Resample();
@@ -300,96 +505,212 @@ void Snake::HandleTailOverlap(const SnakeContainer &converged_snakes) {
   }
 }
 
-PointIterator Snake::CheckHeadOverlap(
-    PointIterator const &start, const SnakeContainer &converged_snakes) {
-  PointIterator it = start;
-  while (it != vertices_.end() && VertexOverlap(*it, converged_snakes)) {
-    ++it;
+unsigned Snake::CheckHeadOverlap(unsigned start,
+                                 const SnakeIndex &converged_snakes) {
+  unsigned i = start;
+  if (i == vertices_.size() || !this->TipOverlap(
+          vertices_.GetPoint(i), converged_snakes, head_clearance_)) {
+    return i;
+  }
+  ++i;
+  while (i != vertices_.size() &&
+         VertexOverlap(vertices_.GetPoint(i), converged_snakes)) {
+    ++i;
   }
-  return it;
+  return i;
 }
 
-PointIterator Snake::CheckTailOverlap(
-    PointIterator const &start, const SnakeContainer &converged_snakes) {
-  PointIterator it = start;
-  while (it != vertices_.begin() && VertexOverlap(*it, converged_snakes)) {
-    --it;
+unsigned Snake::CheckTailOverlap(unsigned start,
+                                 const SnakeIndex &converged_snakes) {
+  unsigned i = start;
+  if (i == 0 || !this->TipOverlap(vertices_.GetPoint(i), converged_snakes,
+                                  tail_clearance_)) {
+    return i;
   }
-  return it;
+  --i;
+  while (i != 0 && VertexOverlap(vertices_.GetPoint(i), converged_snakes)) {
+    --i;
+  }
+  return i;
 }
 
 bool Snake::VertexOverlap(const PointType &p,
-                          const SnakeContainer &converged_snakes) {
-  if (converged_snakes.empty()) return false;
-  for (SnakeConstIterator it = converged_snakes.begin();
-       it != converged_snakes.end(); ++it) {
-    if ((*it)->PassThrough(p, overlap_threshold_))
-      return true;
+                          const SnakeIndex &converged_snakes) {
+  return converged_snakes.HasVertexWithin(p,
+                                          parameters_->overlap_threshold());
+}
+
+/*
+ * Implementation Notes: TipOverlap:
+ * ---------------------------------
+ * The converged snakes only change when another snake converges, while a
+ * tip moves by a fraction of a pixel per iteration. A query records the
+ * distance from the tip to the converged snakes, looking up to twice
+ * overlap_threshold away. If the tip has since moved by m, every
+ * converged vertex is still at least distance - m away, so the tip
+ * cannot overlap while m <= distance - overlap_threshold. A new
+ * converged snake changes the index version and forces a new query.
+ */
+bool Snake::TipOverlap(const PointType &p,
+                       const SnakeIndex &converged_snakes,
+                       Clearance &clearance) {
+  const double threshold = parameters_->overlap_threshold();
+  if (clearance.version == converged_snakes.version() &&
+      p.EuclideanDistanceTo(clearance.point) + threshold <=
+      clearance.distance) {
+    return false;
+  }
+  clearance.version = converged_snakes.version();
+  clearance.point = p;
+  clearance.distance = converged_snakes.ComputeClearance(p, 2 * threshold);
+  return clearance.distance < threshold;
+}
+
+void Snake::GetBounds(PointType &low, PointType &high) const {
+  for (unsigned k = 0; k < kDimension; ++k) {
+    const double *c = vertices_.coordinates(k);
+    low[k] = high[k] = c[0];
+    for (unsigned i = 1; i < vertices_.size(); ++i) {
+      low[k] = std::min(low[k], c[i]);
+      high[k] = std::max(high[k], c[i]);
+    }
   }
-  return false;
 }
 
 bool Snake::PassThrough(const PointType &p, double threshold) const {
-  for (PointConstIterator it = vertices_.begin();
-       it != vertices_.end(); ++it) {
-    double dist = p.EuclideanDistanceTo(*it);
-    if (dist < threshold)
+  const double *x = vertices_.coordinates(0);
+  const double *y = vertices_.coordinates(1);
+  const double *z = vertices_.coordinates(2);
+  const double squared_threshold = threshold * threshold;
+  for (unsigned i = 0; i < vertices_.size(); ++i) {
+    const double dx = p[0] - x[i];
+    const double dy = p[1] - y[i];
+    const double dz = p[2] - z[i];
+    if (dx * dx + dy * dy + dz * dz < squared_threshold)
       return true;
   }
   return false;
 }
 
 void Snake::FindHookedSnakeAndIndex(const PointType &p,
-                                    const SnakeContainer &converged_snakes,
+                                    const SnakeIndex &converged_snakes,
                                     Snake * &s, unsigned &index) {
-  double min_d = kPlusInfinity;
-  for (SnakeConstIterator it = converged_snakes.begin();
-       it != converged_snakes.end(); ++it) {
-    unsigned ind;
-    double d = (*it)->FindClosestIndexTo(p, ind);
-    if (d < min_d) {
-      min_d = d;
-      index = ind;
-      s = *it;
-    }
-  }
+  converged_snakes.FindNearestVertex(p, s, index);
 }
 
 
-double Snake::FindClosestIndexTo(const PointType &p, unsigned &ind) {
-  double min_d = p.EuclideanDistanceTo(vertices_[0]);
-  ind = 0;
+void Snake::IterateOnce(SolverBank *solver, unsigned dim) {
+  VectorContainer &rhs = GetWorkspace().rhs;
+  this->ComputeRHSVector(solver->gamma(), rhs, dim);
+  VertexBuffer &next = this->GetNextVertices(dim);
+  solver->SolveSystem(rhs, dim, open_, next);
+  this->CompleteIteration(next);
+}
 
-  for (unsigned i = 1; i < vertices_.size(); ++i) {
-    double d = p.EuclideanDistanceTo(vertices_[i]);
-    if (d < min_d) {
-      min_d = d;
-      ind = i;
-    }
+void Snake::IterateAdaptively(SolverBank *solver, unsigned dim) {
+  if ((!this->HeadIsFixed() && this->ApproachesConverged(head_clearance_)) ||
+      (!this->TailIsFixed() && this->ApproachesConverged(tail_clearance_))) {
+    step_level_ = 0;
+    step_streak_ = 0;
   }
-  return min_d;
+  const double gamma = solver->gamma() / (1u << step_level_);
+  VectorContainer &rhs = GetWorkspace().rhs;
+  this->ComputeRHSVector(gamma, rhs, dim);
+  VertexBuffer &next = this->GetNextVertices(dim);
+  solver->SolveSystem(rhs, dim, open_, next, gamma);
+  this->CompleteIteration(next);
+  this->UpdateStepLevel(solve_displacement_ * gamma);
 }
 
-void Snake::IterateOnce(SolverBank *solver, unsigned dim) {
-  VectorContainer rhs;
-  this->ComputeRHSVector(solver->gamma(), rhs, dim);
+bool Snake::ApproachesConverged(const Clearance &clearance) const {
+  return clearance.distance < 2 * parameters_->overlap_threshold();
+}
 
-  for (unsigned d = 0; d < dim; ++d) {
-    solver->SolveSystem(rhs, d, open_);
-    for (unsigned i = 0; i < vertices_.size(); ++i) {
-      double value = solver->GetSolution(vertices_.size(), i, open_);
-      vertices_.at(i)[d] = value;
+void Snake::UpdateStepLevel(double velocity) {
+  if (velocity < last_velocity_) {
+    if (++step_streak_ >= kStepStreak && step_level_ < kMaxStepLevel) {
+      step_level_++;
+      step_streak_ = 0;
     }
+  } else {
+    if (step_level_ > 0)
+      step_level_--;
+    step_streak_ = 0;
   }
+  last_velocity_ = velocity;
+}
+
+VertexBuffer &Snake::GetNextVertices(unsigned dim) const {
+  VertexBuffer &next = GetWorkspace().next_vertices;
+  next.Clear();
+  next.Resize(vertices_.size());
+  for (unsigned k = dim; k < kDimension; ++k) {
+    std::copy(vertices_.coordinates(k),
+              vertices_.coordinates(k) + vertices_.size(),
+              next.coordinates(k));
+  }
+  return next;
+}
 
+void Snake::CompleteIteration(VertexBuffer &next) {
   if (this->HeadIsFixed())
-    vertices_.front() = fixed_head_;
+    next.SetPoint(0, fixed_head_);
   if (this->TailIsFixed())
-    vertices_.back() = fixed_tail_;
+    next.SetPoint(next.size() - 1, fixed_tail_);
+
+  const double *x = vertices_.coordinates(0);
+  const double *y = vertices_.coordinates(1);
+  const double *z = vertices_.coordinates(2);
+  const double *next_x = next.coordinates(0);
+  const double *next_y = next.coordinates(1);
+  const double *next_z = next.coordinates(2);
+  double max_squared_displacement = 0.0;
+  for (unsigned i = 0; i < vertices_.size(); ++i) {
+    const double dx = next_x[i] - x[i];
+    const double dy = next_y[i] - y[i];
+    const double dz = next_z[i] - z[i];
+    max_squared_displacement = std::max(max_squared_displacement,
+                                        dx * dx + dy * dy + dz * dz);
+  }
+  solve_displacement_ = std::sqrt(max_squared_displacement);
 
+  vertices_.Swap(next);
+  solved_ = true;
   iterations_++;
 }
 
+void Snake::IterateGroup(SolverBank *solver, const SnakeContainer &group,
+                         unsigned dim) {
+  const unsigned order = group.front()->GetSize();
+  const unsigned lanes = group.size();
+  const unsigned width = kDimension * lanes;
+  Workspace &workspace = GetWorkspace();
+  DataContainer &batch = workspace.batch;
+  batch.resize(order * width);
+
+  VectorContainer &rhs = workspace.rhs;
+  for (unsigned lane = 0; lane < lanes; ++lane) {
+    group[lane]->ComputeRHSVector(solver->gamma(), rhs, dim);
+    for (unsigned i = 0; i < order; ++i) {
+      for (unsigned k = 0; k < kDimension; ++k)
+        batch[i * width + k * lanes + lane] = rhs[i][k];
+    }
+  }
+
+  solver->SolveSystems(&batch[0], order, width, group.front()->open());
+
+  for (unsigned lane = 0; lane < lanes; ++lane) {
+    Snake *s = group[lane];
+    VertexBuffer &next = s->GetNextVertices(dim);
+    for (unsigned k = 0; k < dim; ++k) {
+      double *coordinates = next.coordinates(k);
+      for (unsigned i = 0; i < order; ++i)
+        coordinates[i] = batch[i * width + k * lanes + lane];
+    }
+    s->CompleteIteration(next);
+  }
+}
+
 void Snake::ComputeRHSVector(double gamma, VectorContainer &rhs, unsigned dim) {
   this->AddVerticesInfo(gamma, rhs);
   this->AddExternalForce(rhs, dim);
@@ -399,9 +720,10 @@ void Snake::ComputeRHSVector(double gamma, VectorContainer &rhs, unsigned dim) {
 
 void Snake::AddExternalForce(VectorContainer &rhs, unsigned dim) {
   for (unsigned i = 0; i < vertices_.size(); ++i) {
-    if (IsInsideImage(vertices_.at(i), dim)) {
-      rhs.at(i) += external_factor_ *
-                   vector_interpolator_->Evaluate(vertices_.at(i));
+    const PointType vertex = vertices_.GetPoint(i);
+    if (IsInsideImage(vertex, dim)) {
+      rhs[i] += parameters_->external_factor() *
+          vector_interpolator_->Evaluate(vertex);
     }
   }
 }
@@ -409,48 +731,54 @@ void Snake::AddExternalForce(VectorContainer &rhs, unsigned dim) {
 
 void Snake::AddStretchingForce(VectorContainer &rhs, unsigned dim) {
   this->UpdateHeadTangent();
-  if (IsInsideImage(vertices_.front(), dim) && !this->HeadIsFixed()) {
+  if (IsInsideImage(vertices_.GetHead(), dim) && !this->HeadIsFixed()) {
     double z_damp = 1;
-    if (damp_z_)
+    if (parameters_->damp_z())
       z_damp = exp(-fabs(head_tangent_[2]));
 
     double head_multiplier = this->ComputeLocalStretch(0, dim);
-    rhs.front() += stretch_factor_ * z_damp * head_multiplier * head_tangent_;
+    rhs.front() += parameters_->stretch_factor() * z_damp *
+        head_multiplier * head_tangent_;
   }
 
   this->UpdateTailTangent();
-  if (IsInsideImage(vertices_.back(), dim) && !this->TailIsFixed()) {
+  if (IsInsideImage(vertices_.GetTail(), dim) && !this->TailIsFixed()) {
     double z_damp = 1;
-    if (damp_z_)
+    if (parameters_->damp_z())
       z_damp = exp(-fabs(tail_tangent_[2]));
 
     double tail_multiplier = this->ComputeLocalStretch(
         vertices_.size() - 1, dim);
-    rhs.back() += stretch_factor_ * z_damp * tail_multiplier * tail_tangent_;
+    rhs.back() += parameters_->stretch_factor() * z_damp *
+        tail_multiplier * tail_tangent_;
   }
 }
 
 void Snake::AddVerticesInfo(double gamma, VectorContainer &rhs) {
-  for (unsigned i = 0; i < vertices_.size(); ++i) {
-    VectorType vector = vertices_.at(i).GetVectorFromOrigin();
-    rhs.push_back(vector * gamma);
+  rhs.resize(vertices_.size());
+  for (unsigned k = 0; k < kDimension; ++k) {
+    const double *coordinates = vertices_.coordinates(k);
+    for (unsigned i = 0; i < vertices_.size(); ++i)
+      rhs[i][k] = coordinates[i] * gamma;
   }
 }
 
 void Snake::UpdateHeadTangent() {
-  if (vertices_.size() - 1 < delta_)
-    head_tangent_ = vertices_.front() - vertices_.back();
+  const unsigned delta = parameters_->delta();
+  if (vertices_.size() - 1 < delta)
+    head_tangent_ = vertices_.GetHead() - vertices_.GetTail();
   else
-    head_tangent_ = vertices_.front() - vertices_.at(delta_);
+    head_tangent_ = vertices_.GetHead() - vertices_.GetPoint(delta);
   head_tangent_.Normalize();
 }
 
 void Snake::UpdateTailTangent() {
-  if (vertices_.size() - 1 < delta_)
-    tail_tangent_ = vertices_.back() - vertices_.front();
+  const unsigned delta = parameters_->delta();
+  if (vertices_.size() - 1 < delta)
+    tail_tangent_ = vertices_.GetTail() - vertices_.GetHead();
   else
-    tail_tangent_ = vertices_.back() -
-                    vertices_.at(vertices_.size() - 1 - delta_);
+    tail_tangent_ = vertices_.GetTail() -
+                    vertices_.GetPoint(vertices_.size() - 1 - delta);
   tail_tangent_.Normalize();
 }
 
@@ -458,8 +786,9 @@ void Snake::UpdateTailTangent() {
 /* Note that scaling the intensity is not necessary here because they
  * are cancelled out. */
 double Snake::ComputeLocalStretch(unsigned index, unsigned dim) {
-  double fg = interpolator_->Evaluate(vertices_[index]);
-  if (fg < background_ + kEpsilon || fg > foreground_)
+  double fg = interpolator_->Evaluate(vertices_.GetPoint(index));
+  if (fg < parameters_->background() + kEpsilon ||
+      fg > parameters_->foreground())
     return 0.0;
 
   double bg = 0.0;
@@ -474,7 +803,7 @@ double Snake::ComputeLocalStretch(unsigned index, unsigned dim) {
 }
 
 double Snake::ComputeBackgroundMeanIntensity(unsigned index) const {
-  const PointType &vertex = vertices_[index];
+  const PointType vertex = vertices_.GetPoint(index);
   const VectorType &normal = this->ComputeUnitTangentVector(index);
 
   assert(std::fabs(normal.GetNorm() - 1.0) < 1e-9);
@@ -497,18 +826,21 @@ double Snake::ComputeBackgroundMeanIntensity(unsigned index) const {
     short_axis = itk::CrossProduct(long_axis, normal);
     short_axis.Normalize();
   }
-  DataContainer bgs;
-  const double angle_step = 2 * kPi / number_of_sectors_;
-  for (int r = radial_near_; r < radial_far_; r++) {
-    for (int s = 0; s < number_of_sectors_; s++) {
+  DataContainer &bgs = GetWorkspace().intensities;
+  bgs.clear();
+  const int number_of_sectors = parameters_->number_of_sectors();
+  const double angle_step = 2 * kPi / number_of_sectors;
+  for (int r = parameters_->radial_near(); r < parameters_->radial_far();
+       r++) {
+    for (int s = 0; s < number_of_sectors; s++) {
       double angle = s * angle_step;
       VectorType v = static_cast<double>(r) * (std::cos(angle) * long_axis +
                                                std::sin(angle) * short_axis);
-      v[2] *= z_spacing_;
+      v[2] *= parameters_->z_spacing();
       PointType p = vertex + v;
       if (IsInsideImage(p)) {
         double intensity = interpolator_->Evaluate(p);
-        if (intensity > background_)
+        if (intensity > parameters_->background())
           bgs.push_back(intensity);
       }
     }
@@ -523,10 +855,12 @@ double Snake::ComputeBackgroundMeanIntensity(unsigned index) const {
 
 double Snake::ComputeBackgroundMeanIntensity2d(unsigned index) const {
   const VectorType &normal = this->ComputeUnitTangentVector(index);
-  PointType vertex = vertices_[index];
-  DataContainer bgs;
+  PointType vertex = vertices_.GetPoint(index);
+  DataContainer &bgs = GetWorkspace().intensities;
+  bgs.clear();
 
-  for (int d = radial_near_; d < radial_far_; d++) {
+  for (int d = parameters_->radial_near(); d < parameters_->radial_far();
+       d++) {
     PointType pod;
     pod[0] = this->ComputePodX(vertex[0], normal, d, true);
     pod[1] = this->ComputePodY(vertex[1], normal, d, false);
@@ -633,7 +967,8 @@ void Snake::ComputeSamplePoint(PointType &point, const PointType &origin,
   }
   point = origin + static_cast<double>(d) * radial;
   if (s) {
-    transform_->SetRotation(normal, 2*kPi*s / number_of_sectors_);
+    transform_->SetRotation(normal,
+                            2*kPi*s / parameters_->number_of_sectors());
     transform_->SetCenter(origin);
     point = transform_->TransformPoint(point);
   }
@@ -658,27 +993,29 @@ bool Snake::IsInsideImage(const PointType &point, unsigned dim,
  * overlap part in the body. The reason for detecting first body overlap only
  * is the non-overlap parts will form new snakes which will evolve again.
  */
-void Snake::CheckBodyOverlap(const SnakeContainer &converged_snakes) {
+void Snake::CheckBodyOverlap(const SnakeIndex &converged_snakes) {
   if (!converged_) return;
 
+  const unsigned size = vertices_.size();
   bool last_is_overlap = true;
-  PointIterator overlap_start = vertices_.end();
-  PointIterator overlap_end = vertices_.end();
+  unsigned overlap_start = size;
+  unsigned overlap_end = size;
   // PointType overlap_point;
-  for (PointIterator it = vertices_.begin(); it != vertices_.end(); ++it) {
-    bool overlap = Snake::VertexOverlap(*it, converged_snakes);
+  for (unsigned i = 0; i != size; ++i) {
+    bool overlap = Snake::VertexOverlap(vertices_.GetPoint(i),
+                                        converged_snakes);
     if (overlap && !last_is_overlap) {
-      overlap_start = it;
-    } else if (!overlap && last_is_overlap && it > overlap_start) {
-      overlap_end = it;
+      overlap_start = i;
+    } else if (!overlap && last_is_overlap && i > overlap_start) {
+      overlap_end = i;
       break;
     }
     last_is_overlap = overlap;
   }
 
-  if (overlap_end != vertices_.end()) {
-    this->TryInitializeFromPart(overlap_end-1, vertices_.end(), true);
-    this->TryInitializeFromPart(vertices_.begin(), overlap_start+1, true);
+  if (overlap_end != size) {
+    this->TryInitializeFromPart(overlap_end-1, size, true);
+    this->TryInitializeFromPart(0, overlap_start+1, true);
     viable_ = false;
     // std::cout << "\nbody overlap detected." << std::endl;
   }
@@ -738,8 +1075,8 @@ void Snake::AddJunctionIndex(unsigned index) {
 }
 
 void Snake::CopySubSnakes(SnakeContainer &c) {
-  PointIterator s, e;
-  s = e = vertices_.begin();
+  unsigned s, e;
+  s = e = 0;
 
   if (!junction_indices_.empty()) {
     // add the head sub snake which is not subject to
@@ -751,10 +1088,10 @@ void Snake::CopySubSnakes(SnakeContainer &c) {
     // }
     // std::cout << "end of it" << std::endl;
 
-    s = vertices_.begin() + indices[0];
-    PointContainer points(vertices_.begin(), s);
-    points.push_back(*s);
-    Snake *snake = new Snake(points, true, false, image_,
+    s = indices[0];
+    PointContainer points = vertices_.GetPoints(0, s);
+    points.push_back(vertices_.GetPoint(s));
+    Snake *snake = new Snake(points, parameters_, true, false, image_,
                              external_force_, interpolator_,
                              vector_interpolator_, transform_);
     snake->Resample();
@@ -770,7 +1107,7 @@ void Snake::CopySubSnakes(SnakeContainer &c) {
     //   // add the junction point too
     //   points.push_back(*e);
 
-    //   Snake *snake = new Snake(points, true, true);
+    //   Snake *snake = new Snake(points, parameters_, true, true);
     //   snake->Resample();
     //   if (snake->viable())
     //     c.push_back(snake);
@@ -778,11 +1115,11 @@ void Snake::CopySubSnakes(SnakeContainer &c) {
     // }
     for (std::vector<unsigned>::iterator it = indices.begin() + 1;
          it != indices.end(); ++it) {
-      e = vertices_.begin() + (*it);
-      PointContainer points(s, e);
+      e = *it;
+      PointContainer points = vertices_.GetPoints(s, e);
       // add the junction point too
-      points.push_back(*e);
-      Snake *snake = new Snake(points, true, true, image_,
+      points.push_back(vertices_.GetPoint(e));
+      Snake *snake = new Snake(points, parameters_, true, true, image_,
                                external_force_, interpolator_,
                                vector_interpolator_, transform_);
       snake->Resample();
@@ -793,8 +1130,8 @@ void Snake::CopySubSnakes(SnakeContainer &c) {
   }
   // add the tail sub snake which is not subject to
   // the grouping_distance_threshold
-  PointContainer points(s, vertices_.end());
-  Snake *snake = new Snake(points, true, false, image_,
+  PointContainer points = vertices_.GetPoints(s, vertices_.size());
+  Snake *snake = new Snake(points, parameters_, true, false, image_,
                            external_force_, interpolator_,
                            vector_interpolator_, transform_);
   snake->Resample();
@@ -807,24 +1144,77 @@ void Snake::CopySubSnakes(SnakeContainer &c) {
 void Snake::EvolveWithTipFixed(SolverBank *solver, unsigned max_iter,
                                unsigned dim) {
   unsigned iter = 0;
-  fixed_head_ = vertices_.front();
-  fixed_tail_ = vertices_.back();
-
-  while (viable_ && iter < max_iter) {
-    if (!(iterations_ % check_period_)) {
-      if (this->IsConverged())
-        break;
-    }
+  this->StartEvolutionWithTipFixed();
 
+  while (this->ContinueEvolutionWithTipFixed(iter, max_iter)) {
     this->IterateOnce(solver, dim);
     this->Resample();
     iter++;
   }
+  this->FinishEvolutionWithTipFixed();
+}
+
+void Snake::EvolveBatchWithTipFixed(SolverBank *solver,
+                                    const SnakeContainer &snakes,
+                                    unsigned max_iter, unsigned dim) {
+  typedef std::map<std::pair<unsigned, bool>, SnakeContainer> GroupMap;
+
+  SnakeContainer evolving;
+  for (SnakeConstIterator it = snakes.begin(); it != snakes.end(); ++it) {
+    (*it)->StartEvolutionWithTipFixed();
+    evolving.push_back(*it);
+  }
+
+  unsigned iter = 0;
+  while (!evolving.empty()) {
+    GroupMap groups;
+    SnakeContainer still_evolving;
+    for (SnakeIterator it = evolving.begin(); it != evolving.end(); ++it) {
+      if ((*it)->ContinueEvolutionWithTipFixed(iter, max_iter)) {
+        still_evolving.push_back(*it);
+        groups[std::make_pair((*it)->GetSize(), (*it)->open())].push_back(
+            *it);
+      } else {
+        (*it)->FinishEvolutionWithTipFixed();
+      }
+    }
+    evolving.swap(still_evolving);
+
+    for (GroupMap::iterator it = groups.begin(); it != groups.end(); ++it) {
+      const SnakeContainer &group = it->second;
+      if (group.size() > 1 && solver->direct()) {
+        Snake::IterateGroup(solver, group, dim);
+      } else {
+        for (SnakeConstIterator sit = group.begin(); sit != group.end();
+             ++sit) {
+          (*sit)->IterateOnce(solver, dim);
+        }
+      }
+    }
+
+    for (SnakeIterator it = evolving.begin(); it != evolving.end(); ++it)
+      (*it)->Resample();
+    iter++;
+  }
+}
+
+void Snake::StartEvolutionWithTipFixed() {
+  fixed_head_ = vertices_.GetHead();
+  fixed_tail_ = vertices_.GetTail();
+}
+
+bool Snake::ContinueEvolutionWithTipFixed(unsigned iter, unsigned max_iter) {
+  if (!viable_ || iter >= max_iter)
+    return false;
+  return !this->IsConverged();
+}
+
+void Snake::FinishEvolutionWithTipFixed() {
   final_ = true;
   this->Resample();
 }
 
-const PointType &Snake::GetTip(bool is_head) const {
+PointType Snake::GetTip(bool is_head) const {
   if (is_head)
     return this->GetHead();
   else
@@ -855,9 +1245,10 @@ bool Snake::ComputeLocalSNRAtIndex(unsigned index, int radial_near,
 bool Snake::ComputeLocalBackgroundMeanStd(unsigned index, int radial_near,
                                           int radial_far, double &mean,
                                           double &std) const {
-  DataContainer bgs;
+  DataContainer &bgs = GetWorkspace().intensities;
+  bgs.clear();
   const VectorType normal = this->ComputeUnitTangentVector(index);
-  PointType vertex = vertices_.at(index);
+  PointType vertex = vertices_.GetPoint(index);
   VectorType z_axis;
   z_axis[0] = 0.0;
   z_axis[1] = 0.0;
@@ -885,7 +1276,7 @@ bool Snake::ComputeLocalBackgroundMeanStd(unsigned index, int radial_near,
       double angle = s * angle_step;
       VectorType v = static_cast<double>(r) * (std::cos(angle) * long_axis +
                                                std::sin(angle) * short_axis);
-      v[2] *= z_spacing_;
+      v[2] *= parameters_->z_spacing();
       PointType p = vertex + v;
       if (IsInsideImage(p)) {
         bgs.push_back(interpolator_->Evaluate(p));
@@ -908,17 +1299,17 @@ VectorType Snake::ComputeUnitTangentVector(unsigned index) const {
     if (head_tangent_[0]) {
       return head_tangent_;
     } else {
-      tangent = vertices_.at(0) - vertices_.at(1);
+      tangent = vertices_.GetPoint(0) - vertices_.GetPoint(1);
     }
   } else if (index == vertices_.size() - 1) {
     if (tail_tangent_[0]) {
       return tail_tangent_;
     } else {
-      tangent = vertices_.at(vertices_.size() - 2) -
-                vertices_.at(vertices_.size() - 1);
+      tangent = vertices_.GetPoint(vertices_.size() - 2) -
+                vertices_.GetPoint(vertices_.size() - 1);
     }
   } else {
-    tangent = vertices_.at(index - 1) - vertices_.at(index + 1);
+    tangent = vertices_.GetPoint(index - 1) - vertices_.GetPoint(index + 1);
   }
 
   tangent.Normalize();
@@ -926,16 +1317,18 @@ VectorType Snake::ComputeUnitTangentVector(unsigned index) const {
 }
 
 void Snake::Trim(unsigned start, unsigned end) {
-  vertices_.erase(vertices_.begin() + start,
-                  vertices_.begin() + end);
+  vertices_.Erase(start, end);
+  this->ResetConvergenceTracking();
 }
 
 void Snake::ExtendHead(const PointType &p) {
-  vertices_.push_front(p);
+  vertices_.PushFront(p);
+  this->ResetConvergenceTracking();
 }
 
 void Snake::ExtendTail(const PointType &p) {
-  vertices_.push_back(p);
+  vertices_.PushBack(p);
+  this->ResetConvergenceTracking();
 }
 
 void Snake::TrimAndInsert(unsigned start, unsigned end, const PointType &p) {
@@ -944,14 +1337,15 @@ void Snake::TrimAndInsert(unsigned start, unsigned end, const PointType &p) {
     start = end;
     end = temp;
   }
-  vertices_.insert(vertices_.erase(vertices_.begin() + start,
-                                   vertices_.begin() + end), p);
+  vertices_.Erase(start, end);
+  vertices_.Insert(start, p);
+  this->ResetConvergenceTracking();
 }
 
 double Snake::ComputeIntensity() const {
   double intensity_sum = 0.0;
   for (unsigned i = 0; i < vertices_.size(); ++i) {
-    intensity_sum += interpolator_->Evaluate(vertices_.at(i));
+    intensity_sum += interpolator_->Evaluate(vertices_.GetPoint(i));
   }
   return intensity_sum / vertices_.size();
 }
@@ -962,7 +1356,7 @@ double Snake::ComputeSNR() const {
   for (unsigned i = 0; i < vertices_.size(); i++) {
     double snr = 0.0;
     bool bg_exist = this->ComputeLocalSNRAtIndex(
-        i, radial_near_, radial_far_, snr);
+        i, parameters_->radial_near(), parameters_->radial_far(), snr);
     if (bg_exist) {
       sum += snr;
       cnt++;
@@ -10,20 +10,25 @@
 #ifndef SNAKE_H_
 #define SNAKE_H_
 
+#include <stdint.h>
 #include <utility>
 #include <vector>
 #include <set>
 #include "./global.h"
+#include "./snake_parameters.h"
+#include "./vertex_buffer.h"
 
 namespace soax {
 
 class SolverBank;
+class SnakeIndex;
 
 
 class Snake {
  public:
-  Snake(const PointContainer &points, bool is_open = true,
-        bool is_grouping = false, ImageType::Pointer image = NULL,
+  Snake(const PointContainer &points, const SnakeParameters *parameters,
+        bool is_open = true, bool is_grouping = false,
+        ImageType::Pointer image = NULL,
         VectorImageType::Pointer external_force = NULL,
         InterpolatorType::Pointer interpolator = NULL,
         VectorInterpolatorType::Pointer vector_interpolator = NULL,
@@ -39,18 +44,24 @@ class Snake {
   void set_initial_state(bool initial) {initial_state_ = initial;}
 
   unsigned GetSize() const {return vertices_.size();}
-  double GetX(unsigned i) const {return vertices_.at(i)[0];}
-  double GetY(unsigned i) const {return vertices_.at(i)[1];}
-  double GetZ(unsigned i) const {return vertices_.at(i)[2];}
-  const PointType &GetPoint(unsigned i) const {return vertices_.at(i);}
-  const PointType &GetHead() const {return vertices_.front();}
-  const PointType &GetTail() const {return vertices_.back();}
-  const PointType &GetTip(bool is_head) const;
-  const PointContainer & vertices() const {return vertices_;}
+  double GetX(unsigned i) const {return vertices_.GetCoordinate(i, 0);}
+  double GetY(unsigned i) const {return vertices_.GetCoordinate(i, 1);}
+  double GetZ(unsigned i) const {return vertices_.GetCoordinate(i, 2);}
+  PointType GetPoint(unsigned i) const {return vertices_.GetPoint(i);}
+  PointType GetHead() const {return vertices_.GetHead();}
+  PointType GetTail() const {return vertices_.GetTail();}
+  PointType GetTip(bool is_head) const;
+
+  /*
+   * Return a copy of the vertices.
+   */
+  PointContainer vertices() const {
+    return vertices_.GetPoints(0, vertices_.size());
+  }
 
   /*
    * Resample snake points to make them equally spaced close to the
-   * specified spacing parameter (desired_spacing_). It will update
+   * specified spacing parameter (desired_spacing). It will update
    * length_, spacing_ and viable_.
    */
   void Resample();
@@ -63,113 +74,58 @@ class Snake {
   void ExtendTail(const PointType &p);
   void TrimAndInsert(unsigned start, unsigned end, const PointType &p);
 
-  // static void set_solver_bank(SolverBank *bank) {solver_bank_ = bank;}
-
-  static double intensity_scaling() {return intensity_scaling_;}
-  static void set_intensity_scaling(double scale) {
-    intensity_scaling_ = scale;
-  }
-
-  static unsigned foreground() {return foreground_;}
-  static void set_foreground(unsigned foreground) {
-    foreground_ = foreground;
-  }
-
-  static unsigned background() {return background_;}
-  static void set_background(unsigned background) {
-    background_ = background;
-  }
-
-  static double desired_spacing() {return desired_spacing_;}
-  static void set_desired_spacing(double spacing) {
-    desired_spacing_ = spacing;
-  }
-
-  static double minimum_length() {return minimum_length_;}
-  static void set_minimum_length(double length) {minimum_length_ = length;}
-
-  static unsigned max_iterations() {return max_iterations_;}
-  static void set_max_iterations(unsigned n) {max_iterations_ = n;}
-
-  static double change_threshold() {return change_threshold_;}
-  static void set_change_threshold(double v) {change_threshold_ = v;}
-
-  static unsigned check_period() {return check_period_;}
-  static void set_check_period(unsigned v) {check_period_ = v;}
-
-  static unsigned iterations_per_press() {return iterations_per_press_;}
-  static void set_iterations_per_press(unsigned n) {
-    iterations_per_press_ = n;
-  }
-
-  // static void set_gamma(double g) {gamma_ = g;}
-
-  static double external_factor() {return external_factor_;}
-  static void set_external_factor(double f) {external_factor_ = f;}
-
-  static double stretch_factor() {return stretch_factor_;}
-  static void set_stretch_factor(double f) {stretch_factor_ = f;}
+  /*
+   * Parameters of the run this snake belongs to. They are shared by all
+   * the snakes of the run and are not owned by the snake.
+   */
+  const SnakeParameters &parameters() const {return *parameters_;}
 
-  static int number_of_sectors() {return number_of_sectors_;}
-  static void set_number_of_sectors(int nsectors) {
-    number_of_sectors_ = nsectors;
-  }
+  const SnakeContainer &subsnakes() const {return subsnakes_;}
 
-  static int radial_near() {return radial_near_;}
   /*
-   * Note radial_near_ cannot be less than 1 because the snake point
-   * has to be included in the local foreground neighborhood.
+   * Evolve the snake for at most max_iter iterations, cutting off the
+   * parts that overlap the snakes in converged_snakes.
    */
-  static void set_radial_near(int rnear) {
-    radial_near_ = rnear > 0 ? rnear : 1;
-  }
+  void Evolve(SolverBank *solver, const SnakeIndex &converged_snakes,
+              unsigned max_iter, unsigned dim);
 
-  static int radial_far() {return radial_far_;}
   /*
-   * Note radial_far must be greater than radial_near_.
+   * Evolve is EvolveIterations followed by CheckBodyOverlap. Calling
+   * them apart lets an evolution be carried out in several steps, as the
+   * state of the iterations is kept in the snake. EvolveIterations
+   * returns true once the snake has converged or is no longer viable.
    */
-  static void set_radial_far(int rfar) {
-    radial_far_ = rfar > 0 ? rfar : 2;
-  }
-
-  static double z_spacing() {return z_spacing_;}
-  static void set_z_spacing(double spacing) {
-    z_spacing_ = spacing;
-  }
-
-  static unsigned delta() {return delta_;}
-  static void set_delta(unsigned n) {delta_ = n;}
-
-  static double overlap_threshold() {return overlap_threshold_;}
-  static void set_overlap_threshold(double t) {
-    overlap_threshold_ = t;
-  }
-
-  static double grouping_distance_threshold() {
-    return grouping_distance_threshold_;
-  }
-  static void set_grouping_distance_threshold(double threshold) {
-    grouping_distance_threshold_ = threshold;
-  }
-
-  static unsigned grouping_delta() {return grouping_delta_;}
-  static void set_grouping_delta(unsigned d) {grouping_delta_ = d;}
-
-  static double direction_threshold() {return direction_threshold_;}
-  static void set_direction_threshold(double t) {direction_threshold_ = t;}
-
-  static bool damp_z() {return damp_z_;}
-  static void set_damp_z(bool d) {damp_z_ = d;}
+  bool EvolveIterations(SolverBank *solver,
+                        const SnakeIndex &converged_snakes,
+                        unsigned max_iter, unsigned dim);
+  void CheckBodyOverlap(const SnakeIndex &converged_snakes);
 
-  const SnakeContainer &subsnakes() const {return subsnakes_;}
-
-  void Evolve(SolverBank *solver, const SnakeContainer &converged_snakes,
-              unsigned max_iter, unsigned dim);
+  /*
+   * Return a new snake in the same state as this one, so that an
+   * evolution can be started over. The subsnakes are not copied.
+   */
+  Snake *Clone() const;
   void EvolveWithTipFixed(SolverBank *solver, unsigned max_iter, unsigned dim);
+
+  /*
+   * Evolve independent snakes with their tips fixed in lockstep. In each
+   * iteration, the snakes with the same size and openness have their
+   * systems solved together in structure-of-arrays form, one snake per
+   * lane. The result is the same as calling EvolveWithTipFixed on each
+   * snake.
+   */
+  static void EvolveBatchWithTipFixed(SolverBank *solver,
+                                      const SnakeContainer &snakes,
+                                      unsigned max_iter, unsigned dim);
   void UpdateHookedIndices();
   void CopySubSnakes(SnakeContainer &c);
   bool PassThrough(const PointType &p, double threshold) const;
 
+  /*
+   * Compute the axis-aligned bounding box of the vertices.
+   */
+  void GetBounds(PointType &low, PointType &high) const;
+
   bool ComputeLocalSNRAtIndex(unsigned index, int radial_near, int radial_far,
                               double &local_snr) const;
 
@@ -181,7 +137,7 @@ class Snake {
   /*
    * Compute the mean background intensity around the tips. The sample points
    * are on a orthogonal plane at tips. The sampling region is a annulus
-   * defined by "radial_near_" and "radial_far_".
+   * defined by "radial_near" and "radial_far".
    */
   double ComputeBackgroundMeanIntensity(unsigned index) const;
   double ComputeBackgroundMeanIntensity2d(unsigned index) const;
@@ -195,13 +151,48 @@ class Snake {
                      unsigned dim = kDimension,
                      double padding = kBoundary) const;
  private:
-  typedef std::vector<std::pair<double, double> > PairContainer;
   typedef std::set<unsigned> IndexSet;
 
   /*
-   * Update length_ and compute length cumulative sum, stored in sums.
+   * Scratch buffers shared by all the snakes evolved in a thread. They
+   * keep their capacity between uses, so that the evolution does not
+   * allocate once the buffers have grown to the largest snake. A buffer
+   * is only borrowed within a single method and never held across
+   * calls that may use it again.
+   */
+  struct Workspace {
+    VectorContainer rhs;
+    DataContainer lengths;
+    DataContainer window_lengths;
+    VertexBuffer vertices;
+    VertexBuffer next_vertices;
+    DataContainer intensities;
+    DataContainer batch;
+
+    /*
+     * Hash key of the unit cell of each vertex with the vertex index,
+     * sorted by key.
+     */
+    std::vector<std::pair<uint64_t, unsigned> > cells;
+  };
+
+  /*
+   * Return the workspace of the calling thread.
+   */
+  static Workspace &GetWorkspace();
+
+  /*
+   * Update length_ and compute the cumulative arc length at each
+   * vertex, stored in lengths.
+   */
+  void UpdateLength(DataContainer &lengths);
+
+  /*
+   * Compute the cumulative arc length at each of the vertices into
+   * lengths, and return the total length.
    */
-  void UpdateLength(PairContainer *sums);
+  static double ComputeCumulativeLengths(const VertexBuffer &vertices,
+                                         DataContainer &lengths);
 
   /*
    * Compute new size for the current resample.
@@ -210,37 +201,153 @@ class Snake {
 
   /*
    * Update vertices_ by linearly interpolating the vertices based on
-   * length cumulative sum.
+   * length cumulative sum. The old vertex buffer is handed over to the
+   * workspace for the next resample.
    */
-  void InterpolateVertices(const PairContainer *sums, unsigned new_size);
+  void InterpolateVertices(const DataContainer &lengths, unsigned new_size);
 
+  /*
+   * Return true and set converged_ if no vertex has moved more than
+   * change_threshold over the last check_period iterations. This is
+   * known without looking at the vertices when the maximum
+   * displacements of these iterations sum up to less than the
+   * threshold. Otherwise, the snake is compared with the one at the
+   * start of the window at the end of each window of check_period
+   * iterations, and a new window is started if it has not settled.
+   */
   bool IsConverged();
+
+  /*
+   * Return true if every vertex is within change_threshold of the point
+   * at the same fraction of arc length on window_vertices_. Unlike a
+   * comparison by index, this works across a change of size, and
+   * vertices sliding along an unchanged curve do not count as moving.
+   */
+  bool StaysWithinWindow() const;
+
+  /*
+   * Count the last solve in the convergence tracking. It is called
+   * after resampling.
+   */
+  void TrackDisplacement();
+
+  /*
+   * Start a new window at the current vertices.
+   */
+  void RestartConvergenceWindow();
+
+  /*
+   * Forget the displacements of the last solves, e.g. when a tip is cut
+   * off at a converged snake. They no longer bound how far the vertices
+   * have moved, while the window still compares the vertices by arc
+   * length.
+   */
+  void ForgetRecentDisplacements();
+
+  /*
+   * Forget all the tracked displacements, e.g. when the vertices are
+   * edited.
+   */
+  void ResetConvergenceTracking();
   void CheckSelfIntersection();
+
+  /*
+   * Find the pair of vertices i < j with j - i >= min_gap that are less
+   * than one unit apart, the one with the smallest i and then the
+   * smallest j. The vertices are bucketed in unit cells so that only
+   * vertices in adjacent cells are compared.
+   */
+  bool FindCloseVertexPair(unsigned min_gap, unsigned &i, unsigned &j) const;
   bool TipsStopAtSameLocation();
-  void TryInitializeFromPart(PointIterator it1, PointIterator it2,
-                             bool is_open);
+  /*
+   * Try to initialize a new snake from the vertices in [start, end) and
+   * add it to subsnakes_ if it is viable.
+   */
+  void TryInitializeFromPart(unsigned start, unsigned end, bool is_open);
 
-  void HandleHeadOverlap(const SnakeContainer &converged_snakes);
-  void HandleTailOverlap(const SnakeContainer &converged_snakes);
+  void HandleHeadOverlap(const SnakeIndex &converged_snakes);
+  void HandleTailOverlap(const SnakeIndex &converged_snakes);
 
   bool HeadIsFixed() {return fixed_head_[0] > 0;}
   bool TailIsFixed() {return fixed_tail_[0] > 0;}
 
-  PointIterator CheckHeadOverlap(PointIterator const &start,
-                                 const SnakeContainer &converged_snakes);
-  PointIterator CheckTailOverlap(PointIterator const &start,
-                                 const SnakeContainer &converged_snakes);
+  unsigned CheckHeadOverlap(unsigned start,
+                            const SnakeIndex &converged_snakes);
+  unsigned CheckTailOverlap(unsigned start,
+                            const SnakeIndex &converged_snakes);
 
   bool VertexOverlap(const PointType &p,
-                     const SnakeContainer &converged_snakes);
+                     const SnakeIndex &converged_snakes);
+
+  /*
+   * A lower bound on the distance from point to the converged snakes,
+   * valid while the index has the given version.
+   */
+  struct Clearance {
+    unsigned long version;
+    PointType point;
+    double distance;
+  };
+
+  /*
+   * Same as VertexOverlap for a tip vertex, but skip the query if the
+   * tip is known to be clear of the converged snakes from an earlier
+   * query around a nearby point.
+   */
+  bool TipOverlap(const PointType &p, const SnakeIndex &converged_snakes,
+                  Clearance &clearance);
 
   void FindHookedSnakeAndIndex(const PointType &p,
-                               const SnakeContainer &converged_snakes,
+                               const SnakeIndex &converged_snakes,
                                Snake * &s, unsigned &index);
-  double FindClosestIndexTo(const PointType &p, unsigned &ind);
 
   void IterateOnce(SolverBank *solver, unsigned dim);
 
+  /*
+   * Same as IterateOnce, but with the step size of the current step
+   * level, which is then updated by UpdateStepLevel. A larger step moves
+   * a tip further between two overlap checks, so the step drops back to
+   * the base one while a free tip approaches a converged snake.
+   */
+  void IterateAdaptively(SolverBank *solver, unsigned dim);
+
+  /*
+   * Return true if the last tip query found a converged vertex within
+   * twice overlap_threshold.
+   */
+  bool ApproachesConverged(const Clearance &clearance) const;
+
+  /*
+   * Raise the step level after kStepStreak consecutive iterations in
+   * which the velocity (maximum vertex displacement per unit step)
+   * decreases, and lower it as soon as the velocity increases.
+   */
+  void UpdateStepLevel(double velocity);
+
+  /*
+   * Return a workspace buffer of the size of vertices_ for a solve to
+   * write the new vertices into. The coordinates from dim on are copied
+   * from vertices_ since the solve does not touch them.
+   */
+  VertexBuffer &GetNextVertices(unsigned dim) const;
+
+  /*
+   * Apply the fixed tips to the solution next, make it the vertices and
+   * count the iteration.
+   */
+  void CompleteIteration(VertexBuffer &next);
+
+  /*
+   * Solve one iteration for a group of snakes with the same size and
+   * openness in a single batch.
+   */
+  static void IterateGroup(SolverBank *solver, const SnakeContainer &group,
+                           unsigned dim);
+
+  void StartEvolutionWithTipFixed();
+  bool ContinueEvolutionWithTipFixed(unsigned iter, unsigned max_iter);
+  void FinishEvolutionWithTipFixed();
+
   void ComputeRHSVector(double gamma, VectorContainer &rhs, unsigned dim);
   void AddExternalForce(VectorContainer &rhs, unsigned dim);
   void AddStretchingForce(VectorContainer &rhs, unsigned dim);
@@ -268,8 +375,6 @@ class Snake {
                           const VectorType &normal,
                           int d, int s) const;
 
-  void CheckBodyOverlap(const SnakeContainer &converged_snakes);
-
   void AddJunctionIndex(unsigned index);
 
   double ComputeLocalForegroundMean(unsigned index, int radial_near) const;
@@ -280,7 +385,8 @@ class Snake {
 
 
 
-  PointContainer vertices_;
+  VertexBuffer vertices_;
+  const SnakeParameters *parameters_;
   bool open_;
   bool grouping_;
   ImageType::Pointer image_;
@@ -289,12 +395,25 @@ class Snake {
   VectorInterpolatorType::Pointer vector_interpolator_;
   TransformType::Pointer transform_;
 
-  PointContainer last_vertices_;
+  /*
+   * Convergence tracking. solve_displacement_ is the maximum vertex
+   * displacement by the last solve, if solved_ is true. window_vertices_
+   * holds the vertices at the start of the current window.
+   * recent_displacements_ is a ring buffer of the maximum vertex
+   * displacements of the last check_period iterations.
+   */
+  bool solved_;
+  double solve_displacement_;
+  VertexBuffer window_vertices_;
+  unsigned window_iterations_;
+  DataContainer recent_displacements_;
+  double recent_displacement_sum_;
+  unsigned recent_count_;
   bool viable_;
 
   /*
    * The snake spacing is 1/(kMimimumEvolvingSize-1) = 0.25 if
-   * initial_state_ is True; otherwise desired_spacing_ is used.
+   * initial_state_ is True; otherwise desired_spacing is used.
    */
   bool initial_state_;
   bool converged_;
@@ -309,6 +428,14 @@ class Snake {
   double intensity_;
   unsigned iterations_;
 
+  /*
+   * State of the adaptive step. The step size is 2^step_level_ / gamma,
+   * where gamma is the step size of the solver bank.
+   */
+  unsigned step_level_;
+  unsigned step_streak_;
+  double last_velocity_;
+
   VectorType head_tangent_;
   VectorType tail_tangent_;
 
@@ -320,108 +447,27 @@ class Snake {
   unsigned head_hooked_index_;
   unsigned tail_hooked_index_;
 
+  Clearance head_clearance_;
+  Clearance tail_clearance_;
+
   /*
    * Snake can be devided into several subsnakes during its evolution.
    */
   SnakeContainer subsnakes_;
   IndexSet junction_indices_;
 
-  // static SolverBank *solver_bank_;
-
-  static double intensity_scaling_;
-  static unsigned foreground_;
-  static unsigned background_;
-
-  static double desired_spacing_;
-
   /*
-   * Maximum number iterations allowed for a snake.
+   * Maximum step level of the adaptive step and number of consecutive
+   * decreasing velocities to raise it.
    */
-  static unsigned max_iterations_;
+  static const unsigned kMaxStepLevel;
+  static const unsigned kStepStreak;
 
-  /*
-   * Change threshold for determining snake convergence. If every
-   * snake point move a distance less than this threshold, then the
-   * snake is converged.
-   */
-  static double change_threshold_;
-
-  /*
-   * Period (# of iterations) of checking convergence.
-   */
-  static unsigned check_period_;
-
-  static unsigned iterations_per_press_;
-  /*
-   * Minimum length for the final snake.
-   */
-  static double minimum_length_;
-
-  // static double gamma_;
-  /*
-   * Weight for external forces.
-   */
-  static double external_factor_;
-
-  /*
-   * Weight for stretch forces.
-   */
-  static double stretch_factor_;
-
-  /*
-   * These thress parameters determine the sampling locations of local
-   * shell in estimating the local background intensity near snake
-   * tips.
-   */
-  static int number_of_sectors_;
-  static int radial_near_;
-  static int radial_far_;
-
-  /*
-   * Number of points apart to compute the tangent vector at snake
-   * tips.
-   */
-  static unsigned delta_;
-
-  /*
-   * Distance threshold for determining overlap with other snakes.
-   */
-  static double overlap_threshold_;
-
-  /*
-   * Distance threshold for determining junctions.
-   */
-  static double grouping_distance_threshold_;
-
-  /*
-   * Number of points apart to compute the snake branch directions for
-   * grouping.
-   */
-  static unsigned grouping_delta_;
-
-  /*
-   * Angle threshold (in radians) for determining if two snake
-   * branches are smooth enough to be linked together during grouping
-   * process.
-   */
-  static double direction_threshold_;
-
-  /*
-   * Flag of damping of stretching along z direction. If it is true,
-   * the stretching forces are reduced if the tangent directions of
-   * tips are along z direction.
-   */
-  static bool damp_z_;
   /*
    * Image boundary size in pixels.
    */
   static const double kBoundary;
 
-  /**
-   * Voxel size relative to x/y.
-   */
-  static double z_spacing_;
-
   DISALLOW_COPY_AND_ASSIGN(Snake);
 };
 
@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file implements the spatial index of snake vertices for SOAX.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include "./snake_index.h"
+#include "./snake.h"
+
+namespace soax {
+
+std::atomic<unsigned long> SnakeIndex::last_version_(0);
+
+SnakeIndex::SnakeIndex(double cell_size, const SnakeIndex *base)
+    : cell_size_(cell_size), base_(base), num_added_(0) {
+  assert(cell_size_ > 0.0);
+  this->UpdateVersion();
+}
+
+void SnakeIndex::Reset(double cell_size) {
+  assert(cell_size > 0.0);
+  this->Clear();
+  cell_size_ = cell_size;
+}
+
+void SnakeIndex::Clear() {
+  snakes_.clear();
+  num_added_ = 0;
+  cells_.clear();
+  this->UpdateVersion();
+}
+
+void SnakeIndex::AddSnake(Snake *s) {
+  const unsigned ordinal = num_added_++;
+  snakes_.push_back(s);
+  for (unsigned i = 0; i < s->GetSize(); ++i) {
+    Entry e;
+    e.x = s->GetX(i);
+    e.y = s->GetY(i);
+    e.z = s->GetZ(i);
+    e.snake = s;
+    e.ordinal = ordinal;
+    e.index = i;
+    uint64_t key = ComputeKey(this->ComputeCellCoordinate(e.x),
+                              this->ComputeCellCoordinate(e.y),
+                              this->ComputeCellCoordinate(e.z));
+    cells_[key].push_back(e);
+  }
+  this->UpdateVersion();
+}
+
+void SnakeIndex::RemoveSnake(Snake *s) {
+  SnakeIterator it = std::find(snakes_.begin(), snakes_.end(), s);
+  if (it == snakes_.end()) return;
+  snakes_.erase(it);
+
+  CellMap::iterator cell = cells_.begin();
+  while (cell != cells_.end()) {
+    Cell &entries = cell->second;
+    Cell::iterator e = entries.begin();
+    for (Cell::iterator other = entries.begin(); other != entries.end();
+         ++other) {
+      if (other->snake != s)
+        *e++ = *other;
+    }
+    entries.erase(e, entries.end());
+    if (entries.empty())
+      cell = cells_.erase(cell);
+    else
+      ++cell;
+  }
+  this->UpdateVersion();
+}
+
+bool SnakeIndex::HasVertexWithin(const PointType &p, double radius) const {
+  if (base_ && base_->HasVertexWithin(p, radius)) return true;
+  if (cells_.empty()) return false;
+  const double squared_radius = radius * radius;
+  int64_t low[kDimension], high[kDimension];
+  for (unsigned k = 0; k < kDimension; ++k) {
+    low[k] = this->ComputeCellCoordinate(p[k] - radius);
+    high[k] = this->ComputeCellCoordinate(p[k] + radius);
+  }
+
+  for (int64_t i = low[0]; i <= high[0]; ++i) {
+    for (int64_t j = low[1]; j <= high[1]; ++j) {
+      for (int64_t k = low[2]; k <= high[2]; ++k) {
+        CellMap::const_iterator it = cells_.find(ComputeKey(i, j, k));
+        if (it == cells_.end()) continue;
+        const Cell &cell = it->second;
+        for (Cell::const_iterator e = cell.begin(); e != cell.end(); ++e) {
+          const double dx = p[0] - e->x;
+          const double dy = p[1] - e->y;
+          const double dz = p[2] - e->z;
+          if (dx * dx + dy * dy + dz * dz < squared_radius)
+            return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+unsigned SnakeIndex::CountSnakesWithin(const PointType &p,
+                                       double radius) const {
+  const unsigned base_count = base_ ? base_->CountSnakesWithin(p, radius) : 0;
+  if (cells_.empty()) return base_count;
+  const double squared_radius = radius * radius;
+  int64_t low[kDimension], high[kDimension];
+  for (unsigned k = 0; k < kDimension; ++k) {
+    low[k] = this->ComputeCellCoordinate(p[k] - radius);
+    high[k] = this->ComputeCellCoordinate(p[k] + radius);
+  }
+
+  std::vector<unsigned> ordinals;
+  for (int64_t i = low[0]; i <= high[0]; ++i) {
+    for (int64_t j = low[1]; j <= high[1]; ++j) {
+      for (int64_t k = low[2]; k <= high[2]; ++k) {
+        CellMap::const_iterator it = cells_.find(ComputeKey(i, j, k));
+        if (it == cells_.end()) continue;
+        const Cell &cell = it->second;
+        for (Cell::const_iterator e = cell.begin(); e != cell.end(); ++e) {
+          const double dx = p[0] - e->x;
+          const double dy = p[1] - e->y;
+          const double dz = p[2] - e->z;
+          if (dx * dx + dy * dy + dz * dz < squared_radius)
+            ordinals.push_back(e->ordinal);
+        }
+      }
+    }
+  }
+  std::sort(ordinals.begin(), ordinals.end());
+  return base_count +
+      (std::unique(ordinals.begin(), ordinals.end()) - ordinals.begin());
+}
+
+double SnakeIndex::ComputeClearance(const PointType &p,
+                                    double max_distance) const {
+  if (base_)
+    max_distance = base_->ComputeClearance(p, max_distance);
+  if (cells_.empty()) return max_distance;
+  double min_d = max_distance * max_distance;
+  int64_t low[kDimension], high[kDimension];
+  for (unsigned k = 0; k < kDimension; ++k) {
+    low[k] = this->ComputeCellCoordinate(p[k] - max_distance);
+    high[k] = this->ComputeCellCoordinate(p[k] + max_distance);
+  }
+
+  for (int64_t i = low[0]; i <= high[0]; ++i) {
+    for (int64_t j = low[1]; j <= high[1]; ++j) {
+      for (int64_t k = low[2]; k <= high[2]; ++k) {
+        CellMap::const_iterator it = cells_.find(ComputeKey(i, j, k));
+        if (it == cells_.end()) continue;
+        const Cell &cell = it->second;
+        for (Cell::const_iterator e = cell.begin(); e != cell.end(); ++e) {
+          const double dx = p[0] - e->x;
+          const double dy = p[1] - e->y;
+          const double dz = p[2] - e->z;
+          min_d = std::min(min_d, dx * dx + dy * dy + dz * dz);
+        }
+      }
+    }
+  }
+  return std::min(std::sqrt(min_d), max_distance);
+}
+
+double SnakeIndex::FindNearestVertex(const PointType &p, Snake * &s,
+                                     unsigned &index) const {
+  const double base_d = base_ ? base_->FindNearestVertex(p, s, index) :
+      kPlusInfinity;
+  if (cells_.empty()) return base_d;
+  const Entry *nearest = NULL;
+  double min_d = kPlusInfinity;
+
+  int64_t center[kDimension];
+  for (unsigned k = 0; k < kDimension; ++k)
+    center[k] = this->ComputeCellCoordinate(p[k]);
+
+  std::size_t visited = 0;
+  for (int64_t r = 0; ; ++r) {
+    const std::size_t side = 2 * r + 1;
+    const std::size_t shell = r ? side * side * side -
+        (side - 2) * (side - 2) * (side - 2) : 1;
+    if (visited + shell > cells_.size()) {
+      for (CellMap::const_iterator it = cells_.begin(); it != cells_.end();
+           ++it) {
+        UpdateNearest(p, it->second, nearest, min_d);
+      }
+      break;
+    }
+
+    for (int64_t i = -r; i <= r; ++i) {
+      for (int64_t j = -r; j <= r; ++j) {
+        // Inside the shell only the two faces along z are visited.
+        const bool inner = std::abs(i) < r && std::abs(j) < r;
+        const int64_t step = inner ? 2 * r : 1;
+        for (int64_t k = -r; k <= r; k += step) {
+          CellMap::const_iterator it = cells_.find(
+              ComputeKey(center[0] + i, center[1] + j, center[2] + k));
+          if (it != cells_.end())
+            UpdateNearest(p, it->second, nearest, min_d);
+        }
+      }
+    }
+    visited += shell;
+
+    // Any vertex outside the visited cells is at least r cells away.
+    const double bound = r * cell_size_;
+    if (nearest && min_d < bound * bound) break;
+  }
+
+  // The snakes of the base come first, so they win ties.
+  const double d = std::sqrt(min_d);
+  if (d >= base_d) return base_d;
+  s = nearest->snake;
+  index = nearest->index;
+  return d;
+}
+
+void SnakeIndex::UpdateNearest(const PointType &p, const Cell &cell,
+                               const Entry * &nearest, double &min_d) {
+  for (Cell::const_iterator e = cell.begin(); e != cell.end(); ++e) {
+    const double dx = p[0] - e->x;
+    const double dy = p[1] - e->y;
+    const double dz = p[2] - e->z;
+    const double d = dx * dx + dy * dy + dz * dz;
+    if (d < min_d || (d == min_d && (e->ordinal < nearest->ordinal ||
+        (e->ordinal == nearest->ordinal && e->index < nearest->index)))) {
+      min_d = d;
+      nearest = &*e;
+    }
+  }
+}
+
+void SnakeIndex::UpdateVersion() {
+  version_ = ++last_version_;
+}
+
+std::size_t SnakeIndex::CellHash::operator()(uint64_t key) const {
+  // Mix the bits so that neighboring cells do not collide in buckets.
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return static_cast<std::size_t>(key);
+}
+
+int64_t SnakeIndex::ComputeCellCoordinate(double x) const {
+  return static_cast<int64_t>(std::floor(x / cell_size_));
+}
+
+uint64_t SnakeIndex::ComputeKey(int64_t i, int64_t j, int64_t k) {
+  const int64_t offset = 1 << 20;
+  const uint64_t mask = (1 << 21) - 1;
+  return (static_cast<uint64_t>(i + offset) & mask) |
+      (static_cast<uint64_t>(j + offset) & mask) << 21 |
+      (static_cast<uint64_t>(k + offset) & mask) << 42;
+}
+
+}  // namespace soax
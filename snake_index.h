@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file defines the spatial index of snake vertices for SOAX.
+ */
+
+
+#ifndef SNAKE_INDEX_H_
+#define SNAKE_INDEX_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include "./global.h"
+
+namespace soax {
+
+/*
+ * A uniform grid over the vertices of a set of snakes, such as the
+ * converged snakes. Each vertex is put in the cubic cell containing it,
+ * and a query only visits the cells overlapping its ball. With the cell
+ * size close to the query radius, a query looks at a constant number of
+ * cells and takes O(1) expected time regardless of the number of snakes.
+ *
+ * The vertices are copied when a snake is added, so a snake must not
+ * change while it is indexed.
+ *
+ * An index can be laid over a base index, in which case the queries
+ * cover the snakes of both and the snakes of the base come first. The
+ * base must not change while the overlay is used. This lets several
+ * threads add snakes to their own overlays of one frozen index.
+ */
+class SnakeIndex {
+ public:
+  explicit SnakeIndex(double cell_size = 1.0, const SnakeIndex *base = NULL);
+
+  /*
+   * Remove all snakes and use the given cell size from now on.
+   */
+  void Reset(double cell_size);
+  void Clear();
+
+  void AddSnake(Snake *s);
+
+  /*
+   * Remove the vertices of s. This visits every cell, so it is meant for
+   * occasional edits such as deleting snakes in the viewer.
+   */
+  void RemoveSnake(Snake *s);
+
+  /*
+   * Snakes added to this index, not including those of the base.
+   */
+  const SnakeContainer &snakes() const {return snakes_;}
+  bool empty() const {
+    return snakes_.empty() && (!base_ || base_->empty());
+  }
+  double cell_size() const {return cell_size_;}
+
+  /*
+   * Stamp that changes whenever snakes are added or removed. Stamps are
+   * never reused, even across indices, so a result computed against a
+   * version stays valid for as long as the version is the same.
+   */
+  unsigned long version() const {return version_;}
+
+  /*
+   * Return true if any indexed vertex is closer than radius to p.
+   */
+  bool HasVertexWithin(const PointType &p, double radius) const;
+
+  /*
+   * Return the number of distinct snakes with a vertex closer than
+   * radius to p.
+   */
+  unsigned CountSnakesWithin(const PointType &p, double radius) const;
+
+  /*
+   * Return the distance from p to the closest indexed vertex, or
+   * max_distance if no vertex is closer than that.
+   */
+  double ComputeClearance(const PointType &p, double max_distance) const;
+
+  /*
+   * Find the indexed vertex closest to p and return its distance, or
+   * kPlusInfinity if the index is empty. Ties go to the snake added
+   * first, then to the lower vertex index.
+   *
+   * The cells are searched in growing cubic shells around p until no
+   * unvisited cell can hold a closer vertex, so the cost depends on the
+   * distance to the nearest vertex rather than on the number of
+   * vertices. When the shells would visit more cells than are occupied,
+   * the occupied cells are scanned instead.
+   */
+  double FindNearestVertex(const PointType &p, Snake * &s,
+                           unsigned &index) const;
+
+  /*
+   * Pack the integer coordinates of a cell into one hash key, 21 bits
+   * each. Coordinates more than 2^20 apart may share a key.
+   */
+  static uint64_t ComputeKey(int64_t i, int64_t j, int64_t k);
+
+ private:
+  struct Entry {
+    double x;
+    double y;
+    double z;
+    Snake *snake;
+
+    /*
+     * Number of snakes added before this one since the last reset.
+     */
+    unsigned ordinal;
+    unsigned index;
+  };
+
+  typedef std::vector<Entry> Cell;
+
+  struct CellHash {
+    std::size_t operator()(uint64_t key) const;
+  };
+
+  typedef std::unordered_map<uint64_t, Cell, CellHash> CellMap;
+
+  void UpdateVersion();
+
+  int64_t ComputeCellCoordinate(double x) const;
+
+  /*
+   * Update the nearest entry and its squared distance min_d with the
+   * entries of cell that are closer to p, or as close but ordered first.
+   */
+  static void UpdateNearest(const PointType &p, const Cell &cell,
+                            const Entry * &nearest, double &min_d);
+
+  double cell_size_;
+  const SnakeIndex *base_;
+  SnakeContainer snakes_;
+  unsigned num_added_;
+  CellMap cells_;
+  unsigned long version_;
+
+  static std::atomic<unsigned long> last_version_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnakeIndex);
+};
+
+}  // namespace soax
+
+#endif  // SNAKE_INDEX_H_
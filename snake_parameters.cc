@@ -0,0 +1,24 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file implements the snake parameters class for SOAX.
+ */
+
+#include "./snake_parameters.h"
+
+namespace soax {
+
+SnakeParameters::SnakeParameters()
+    : intensity_scaling_(0.0), foreground_(65535), background_(0),
+      desired_spacing_(1.0), max_iterations_(10000),
+      change_threshold_(0.1), check_period_(100),
+      iterations_per_press_(100), minimum_length_(10.0),
+      external_factor_(1.0), stretch_factor_(0.2), number_of_sectors_(8),
+      radial_near_(4), radial_far_(8), delta_(4), overlap_threshold_(1.0),
+      grouping_distance_threshold_(4.0), grouping_delta_(8),
+      direction_threshold_(2.1), damp_z_(false), adaptive_step_(false),
+      z_spacing_(2.88) {}
+
+}  // namespace soax
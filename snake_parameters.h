@@ -0,0 +1,231 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file defines the snake parameters class for SOAX.
+ */
+
+
+#ifndef SNAKE_PARAMETERS_H_
+#define SNAKE_PARAMETERS_H_
+
+#include "./global.h"
+
+namespace soax {
+
+/*
+ * Parameters of the snake evolution and grouping. Each Multisnake owns
+ * one set and every snake it creates refers to it as a constant, so
+ * extractions with different parameters do not interfere with each
+ * other. The parameters must not be changed while snakes using them are
+ * being evolved.
+ */
+class SnakeParameters {
+ public:
+  SnakeParameters();
+
+  double intensity_scaling() const {return intensity_scaling_;}
+  void set_intensity_scaling(double scale) {
+    intensity_scaling_ = scale;
+  }
+
+  unsigned foreground() const {return foreground_;}
+  void set_foreground(unsigned foreground) {
+    foreground_ = foreground;
+  }
+
+  unsigned background() const {return background_;}
+  void set_background(unsigned background) {
+    background_ = background;
+  }
+
+  double desired_spacing() const {return desired_spacing_;}
+  void set_desired_spacing(double spacing) {
+    desired_spacing_ = spacing;
+  }
+
+  double minimum_length() const {return minimum_length_;}
+  void set_minimum_length(double length) {minimum_length_ = length;}
+
+  unsigned max_iterations() const {return max_iterations_;}
+  void set_max_iterations(unsigned n) {max_iterations_ = n;}
+
+  double change_threshold() const {return change_threshold_;}
+  void set_change_threshold(double v) {change_threshold_ = v;}
+
+  unsigned check_period() const {return check_period_;}
+  void set_check_period(unsigned v) {check_period_ = v;}
+
+  unsigned iterations_per_press() const {return iterations_per_press_;}
+  void set_iterations_per_press(unsigned n) {
+    iterations_per_press_ = n;
+  }
+
+  double external_factor() const {return external_factor_;}
+  void set_external_factor(double f) {external_factor_ = f;}
+
+  double stretch_factor() const {return stretch_factor_;}
+  void set_stretch_factor(double f) {stretch_factor_ = f;}
+
+  int number_of_sectors() const {return number_of_sectors_;}
+  void set_number_of_sectors(int nsectors) {
+    number_of_sectors_ = nsectors;
+  }
+
+  int radial_near() const {return radial_near_;}
+  /*
+   * Note radial_near_ cannot be less than 1 because the snake point
+   * has to be included in the local foreground neighborhood.
+   */
+  void set_radial_near(int rnear) {
+    radial_near_ = rnear > 0 ? rnear : 1;
+  }
+
+  int radial_far() const {return radial_far_;}
+  /*
+   * Note radial_far must be greater than radial_near_.
+   */
+  void set_radial_far(int rfar) {
+    radial_far_ = rfar > 0 ? rfar : 2;
+  }
+
+  double z_spacing() const {return z_spacing_;}
+  void set_z_spacing(double spacing) {
+    z_spacing_ = spacing;
+  }
+
+  unsigned delta() const {return delta_;}
+  void set_delta(unsigned n) {delta_ = n;}
+
+  double overlap_threshold() const {return overlap_threshold_;}
+  void set_overlap_threshold(double t) {
+    overlap_threshold_ = t;
+  }
+
+  double grouping_distance_threshold() const {
+    return grouping_distance_threshold_;
+  }
+  void set_grouping_distance_threshold(double threshold) {
+    grouping_distance_threshold_ = threshold;
+  }
+
+  unsigned grouping_delta() const {return grouping_delta_;}
+  void set_grouping_delta(unsigned d) {grouping_delta_ = d;}
+
+  double direction_threshold() const {return direction_threshold_;}
+  void set_direction_threshold(double t) {direction_threshold_ = t;}
+
+  bool damp_z() const {return damp_z_;}
+  void set_damp_z(bool d) {damp_z_ = d;}
+
+  bool adaptive_step() const {return adaptive_step_;}
+  void set_adaptive_step(bool a) {adaptive_step_ = a;}
+
+ private:
+  double intensity_scaling_;
+  unsigned foreground_;
+  unsigned background_;
+
+  double desired_spacing_;
+
+  /*
+   * Maximum number iterations allowed for a snake.
+   */
+  unsigned max_iterations_;
+
+  /*
+   * Change threshold for determining snake convergence. If every
+   * snake point move a distance less than this threshold, then the
+   * snake is converged.
+   */
+  double change_threshold_;
+
+  /*
+   * Period (# of iterations) of checking convergence.
+   */
+  unsigned check_period_;
+
+  unsigned iterations_per_press_;
+  /*
+   * Minimum length for the final snake.
+   */
+  double minimum_length_;
+
+  /*
+   * Weight for external forces.
+   */
+  double external_factor_;
+
+  /*
+   * Weight for stretch forces.
+   */
+  double stretch_factor_;
+
+  /*
+   * These thress parameters determine the sampling locations of local
+   * shell in estimating the local background intensity near snake
+   * tips.
+   */
+  int number_of_sectors_;
+  int radial_near_;
+  int radial_far_;
+
+  /*
+   * Number of points apart to compute the tangent vector at snake
+   * tips.
+   */
+  unsigned delta_;
+
+  /*
+   * Distance threshold for determining overlap with other snakes.
+   */
+  double overlap_threshold_;
+
+  /*
+   * Distance threshold for determining junctions.
+   */
+  double grouping_distance_threshold_;
+
+  /*
+   * Number of points apart to compute the snake branch directions for
+   * grouping.
+   */
+  unsigned grouping_delta_;
+
+  /*
+   * Angle threshold (in radians) for determining if two snake
+   * branches are smooth enough to be linked together during grouping
+   * process.
+   */
+  double direction_threshold_;
+
+  /*
+   * Flag of damping of stretching along z direction. If it is true,
+   * the stretching forces are reduced if the tangent directions of
+   * tips are along z direction.
+   */
+  bool damp_z_;
+
+  /*
+   * Flag of adaptive step size. If it is true, the step size of a
+   * snake grows while its vertex velocity keeps decreasing, which
+   * reduces the number of iterations to reach convergence. The step is
+   * at most 8 times the base one, and drops back to it while a free tip
+   * is within twice overlap_threshold of a converged snake, so that no
+   * tip jumps over the overlap checks. The fixed point of the evolution
+   * does not depend on the step size, but a tip on a fading ridge may
+   * stop at a slightly different point. It only takes effect with the
+   * direct solvers.
+   */
+  bool adaptive_step_;
+
+  /**
+   * Voxel size relative to x/y.
+   */
+  double z_spacing_;
+};
+
+}  // namespace soax
+
+#endif  // SNAKE_PARAMETERS_H_
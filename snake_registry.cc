@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file implements the concurrent registry of converged snakes for
+ * SOAX.
+ */
+
+#include "./snake_registry.h"
+
+namespace soax {
+
+/*
+ * Implementation Notes:
+ *
+ * A reader counts itself in readers_ of the published index, then checks
+ * that the index is still the published one, and backs off otherwise.
+ * The writer only changes the index behind after finding no reader
+ * counted in it. Both sides use sequentially consistent operations, so
+ * either the reader sees the index has been retired or the writer sees
+ * the reader, and a reader never uses an index being changed.
+ */
+SnakeRegistry::Snapshot::Snapshot(const SnakeRegistry &registry)
+    : registry_(registry) {
+  for (;;) {
+    buffer_ = registry_.published_.load();
+    registry_.readers_[buffer_]++;
+    if (registry_.published_.load() == buffer_) break;
+    registry_.readers_[buffer_]--;
+  }
+  size_ = registry_.sizes_[buffer_];
+}
+
+SnakeRegistry::Snapshot::~Snapshot() {
+  registry_.readers_[buffer_]--;
+}
+
+SnakeRegistry::SnakeRegistry(double cell_size) : published_(0) {
+  for (unsigned b = 0; b < 2; ++b) {
+    indices_[b].Reset(cell_size);
+    sizes_[b] = 0;
+    readers_[b] = 0;
+  }
+}
+
+void SnakeRegistry::Add(Snake *s) {
+  snakes_.push_back(s);
+  this->Publish();
+}
+
+bool SnakeRegistry::Publish() {
+  const unsigned published = published_.load();
+  if (sizes_[published] == snakes_.size()) return true;
+  const unsigned behind = 1 - published;
+  if (readers_[behind].load()) return false;
+  for (unsigned i = sizes_[behind]; i < snakes_.size(); ++i)
+    indices_[behind].AddSnake(snakes_[i]);
+  sizes_[behind] = snakes_.size();
+  published_.store(behind);
+  return true;
+}
+
+}  // namespace soax
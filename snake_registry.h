@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file defines the concurrent registry of converged snakes for
+ * SOAX.
+ */
+
+
+#ifndef SNAKE_REGISTRY_H_
+#define SNAKE_REGISTRY_H_
+
+#include <atomic>
+#include "./global.h"
+#include "./snake_index.h"
+
+namespace soax {
+
+/*
+ * An append-only set of converged snakes that threads can query while
+ * snakes are being added. Readers take a Snapshot, which pins a
+ * published SnakeIndex of the first snapshot.size() snakes added; it can
+ * be passed to Snake::Evolve as is, and stays the same for as long as
+ * the snapshot lives. Taking and releasing a snapshot is lock-free.
+ *
+ * The snakes are kept in two indices, one published and one behind it.
+ * Publishing brings the index behind up to date and swaps it with the
+ * published one, if no snapshot pins it. A snapshot held for long thus
+ * delays the publication of new snakes, but never blocks the writer.
+ * Add and Publish must not be called by two threads at once.
+ */
+class SnakeRegistry {
+ public:
+  class Snapshot {
+   public:
+    explicit Snapshot(const SnakeRegistry &registry);
+    ~Snapshot();
+
+    const SnakeIndex &index() const {return registry_.indices_[buffer_];}
+
+    /*
+     * Number of snakes in the snapshot, which are the first ones added.
+     */
+    unsigned size() const {return size_;}
+
+   private:
+    const SnakeRegistry &registry_;
+    unsigned buffer_;
+    unsigned size_;
+
+    DISALLOW_COPY_AND_ASSIGN(Snapshot);
+  };
+
+  explicit SnakeRegistry(double cell_size);
+
+  /*
+   * Append s and try to publish it.
+   */
+  void Add(Snake *s);
+
+  /*
+   * Try to publish the snakes added so far, and return true if all of
+   * them are published.
+   */
+  bool Publish();
+
+  /*
+   * Snakes in the order added, for the writer only.
+   */
+  const SnakeContainer &snakes() const {return snakes_;}
+
+ private:
+  SnakeContainer snakes_;
+  SnakeIndex indices_[2];
+
+  /*
+   * Number of snakes in each index.
+   */
+  unsigned sizes_[2];
+
+  std::atomic<unsigned> published_;
+  mutable std::atomic<unsigned> readers_[2];
+
+  DISALLOW_COPY_AND_ASSIGN(SnakeRegistry);
+};
+
+}  // namespace soax
+
+#endif  // SNAKE_REGISTRY_H_
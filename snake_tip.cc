@@ -32,8 +32,9 @@ double SnakeTip::ComputeAngle(const SnakeTip *t1, const SnakeTip *t2) {
 }
 
 VectorType SnakeTip::GetDirection() const {
-  unsigned delta = snake_->GetSize() > Snake::grouping_delta() ?
-      Snake::grouping_delta() : snake_->GetSize();
+  const unsigned grouping_delta = snake_->parameters().grouping_delta();
+  unsigned delta = snake_->GetSize() > grouping_delta ?
+      grouping_delta : snake_->GetSize();
   assert(delta > 0);
   VectorType v;
   if (is_head_) {
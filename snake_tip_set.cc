@@ -64,7 +64,7 @@ void SnakeTipSet::Configure() {
   SnakeTip *t2 = NULL;
 
   double angle = this->FindSmoothestPair(t1, t2);
-  if (angle < Snake::direction_threshold()) {
+  if (angle < tips_.front()->snake()->parameters().direction_threshold()) {
     return;
   } else {
     t1->Link(t2);
@@ -6,11 +6,14 @@
  * This file implements the solvers for linear system for SOAX.
  */
 
+#include <cassert>
 #include "./solver_bank.h"
 
 namespace soax {
 
-SolverBank::SolverBank() : alpha_(0.01), beta_(0.1), gamma_(2.0) {}
+SolverBank::SolverBank() : alpha_(0.01), beta_(0.1), gamma_(2.0),
+                           direct_(true),
+                           cache_(FactorizationCache::GetSharedCache()) {}
 
 SolverBank::~SolverBank() {
   this->ClearSolvers(open_solvers_);
@@ -35,6 +38,7 @@ void SolverBank::Reset(bool reset_matrix) {
   if (reset_matrix) {
     this->ClearSolvers(open_solvers_);
     this->ClearSolvers(closed_solvers_);
+    last_solver_.reset();
   } else {
     this->ResetSolutionAndVector(open_solvers_);
     this->ResetSolutionAndVector(closed_solvers_);
@@ -52,8 +56,32 @@ void SolverBank::ResetSolutionAndVector(SolverContainer &solvers) {
   }
 }
 
-void SolverBank::SolveSystem(const VectorContainer &vectors, unsigned dim,
-                             bool open) {
+void SolverBank::SolveSystem(VectorContainer &vectors, unsigned dim,
+                             bool open, VertexBuffer &points) {
+  if (direct_) {
+    this->SolveSystem(vectors, dim, open, points, gamma_);
+  } else {
+    for (unsigned d = 0; d < dim; ++d)
+      this->SolveIterative(vectors, d, open, points);
+  }
+}
+
+void SolverBank::SolveSystem(VectorContainer &vectors, unsigned dim,
+                             bool open, VertexBuffer &points,
+                             double gamma) {
+  assert(direct_);
+  this->GetDirectSolver(vectors.size(), open, gamma)->Solve(vectors, dim,
+                                                           points);
+}
+
+void SolverBank::SolveSystems(double *data, unsigned order, unsigned width,
+                              bool open) {
+  assert(direct_);
+  this->GetDirectSolver(order, open, gamma_)->SolveBatch(data, width);
+}
+
+void SolverBank::SolveIterative(const VectorContainer &vectors, unsigned d,
+                                bool open, VertexBuffer &points) {
   SolverContainer &solvers = open ? open_solvers_ : closed_solvers_;
   unsigned position = vectors.size() - kMinimumEvolvingSize;
 
@@ -66,10 +94,26 @@ void SolverBank::SolveSystem(const VectorContainer &vectors, unsigned dim,
     this->InitializeSolver(solvers[position], vectors.size(), open);
   }
 
+  SolverType *solver = solvers[position];
   for (unsigned i = 0; i < vectors.size(); ++i) {
-    solvers[position]->SetVectorValue(i, vectors[i][dim], 0);
+    solver->SetVectorValue(i, vectors[i][d], 0);
+  }
+  solver->Solve();
+  double *coordinates = points.coordinates(d);
+  for (unsigned i = 0; i < vectors.size(); ++i) {
+    coordinates[i] = solver->GetSolutionValue(i, 0);
   }
-  solvers[position]->Solve();
+}
+
+const PentadiagonalSolver *SolverBank::GetDirectSolver(unsigned order,
+                                                      bool open,
+                                                      double gamma) {
+  if (!last_solver_ || last_solver_->order() != order ||
+      last_solver_->open() != open ||
+      !last_solver_->Matches(alpha_, beta_, gamma)) {
+    last_solver_ = cache_->GetSolver(order, open, alpha_, beta_, gamma);
+  }
+  return last_solver_.get();
 }
 
 void SolverBank::ExpandSolverContainer(SolverContainer &solvers,
@@ -142,9 +186,4 @@ void SolverBank::FillMatrixClosed(SolverType *solver, unsigned order) {
   }
 }
 
-double SolverBank::GetSolution(unsigned order, unsigned index, bool open) {
-  SolverContainer &solvers = open? open_solvers_ : closed_solvers_;
-  return solvers[order - kMinimumEvolvingSize]->GetSolutionValue(index, 0);
-}
-
 }  // namespace soax
@@ -13,6 +13,7 @@
 #include <vector>
 #include "itkFEMLinearSystemWrapperItpack.h"
 #include "./global.h"
+#include "./factorization_cache.h"
 
 namespace soax {
 
@@ -22,6 +23,16 @@ namespace soax {
  * accessible by the order of the system. This solver bank can be
  * dynamically expanded to accomodate the linear system with the
  * largest order.
+ *
+ * In direct mode (the default), the systems are solved by a banded
+ * LDL^T factorization (cyclic for closed snakes) which is computed once
+ * and reused for every iteration. The factorizations are kept in a
+ * FactorizationCache, which is shared by all the banks of the process
+ * unless another one is set. Otherwise the systems go through the
+ * iterative ITPACK solvers.
+ *
+ * A bank itself is not thread-safe; each thread should use its own bank
+ * and share the cache.
  */
 class SolverBank {
  public:
@@ -30,11 +41,26 @@ class SolverBank {
 
   void Reset(bool reset_matrix = true);
   /*
-   * Solve the linear system with order of vectors.size().
+   * Solve the linear systems with order of vectors.size() for the first
+   * dim components of vectors in one call, and write the solution to
+   * points. The content of vectors is overwritten.
+   */
+  void SolveSystem(VectorContainer &vectors, unsigned dim, bool open,
+                   VertexBuffer &points);
+
+  /*
+   * Same as above, but with a step size other than gamma_. It is only
+   * available in direct mode.
    */
-  void SolveSystem(const VectorContainer &vectors, unsigned dim, bool open);
+  void SolveSystem(VectorContainer &vectors, unsigned dim, bool open,
+                   VertexBuffer &points, double gamma);
 
-  double GetSolution(unsigned order, unsigned index, bool open);
+  /*
+   * Solve a batch of systems with the same order in place. See
+   * PentadiagonalSolver::SolveBatch for the layout of data. It is only
+   * available in direct mode.
+   */
+  void SolveSystems(double *data, unsigned order, unsigned width, bool open);
 
   double alpha() const {return alpha_;}
   void set_alpha(double a) {alpha_ = a;}
@@ -45,6 +71,15 @@ class SolverBank {
   double gamma() const {return gamma_;}
   void set_gamma(double g) {gamma_ = g;}
 
+  bool direct() const {return direct_;}
+  void set_direct(bool d) {direct_ = d;}
+
+  FactorizationCache *factorization_cache() const {return cache_;}
+  void set_factorization_cache(FactorizationCache *cache) {
+    cache_ = cache;
+    last_solver_.reset();
+  }
+
  private:
   typedef itk::fem::LinearSystemWrapperItpack SolverType;
   typedef std::vector<SolverType *> SolverContainer;
@@ -56,6 +91,13 @@ class SolverBank {
 
   void ExpandSolverContainer(SolverContainer &solvers, unsigned position);
 
+  /*
+   * Solve the system for the d-th component of vectors with an ITPACK
+   * solver, and write the solution to the d-th coordinate of points.
+   */
+  void SolveIterative(const VectorContainer &vectors, unsigned d, bool open,
+                      VertexBuffer &points);
+
   void InitializeSolver(SolverType *solver, unsigned order, bool open);
 
   void FillMatrixOpen(SolverType *solver, unsigned order);
@@ -64,6 +106,13 @@ class SolverBank {
 
   void ResetSolutionAndVector(SolverContainer &solvers);
 
+  /*
+   * Return the direct solver for the order, the current alpha_ and
+   * beta_, and the step size gamma from the factorization cache.
+   */
+  const PentadiagonalSolver *GetDirectSolver(unsigned order, bool open,
+                                             double gamma);
+
   /*
    * Solvers for open snakes.
    */
@@ -88,6 +137,22 @@ class SolverBank {
    */
   double gamma_;
 
+  /*
+   * Flag of solving the systems with the direct solvers.
+   */
+  bool direct_;
+
+  /*
+   * Cache of the direct solvers, not owned by the bank.
+   */
+  FactorizationCache *cache_;
+
+  /*
+   * The direct solver used last, which saves a cache lookup when
+   * consecutive systems are the same.
+   */
+  FactorizationCache::SolverPointer last_solver_;
+
   DISALLOW_COPY_AND_ASSIGN(SolverBank);
 };
 
@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file tests that the deterministic parallel deformation converges
+ * to the same snakes, vertex by vertex, with 1, 3 and 4 threads, and
+ * that these are the snakes of the serial deformation. The concurrent
+ * deformation, whose results depend on thread timing, must give them
+ * too on one thread. On 4 threads, only its counts are checked: every
+ * speculative evolution of a parallel scheme must end in a commit or a
+ * retry. Without an image, a synthetic volume with two crossing
+ * filaments is written to deformation_test.mha and used.
+ *
+ * Usage: ./deformation_test [image_filename]
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "../multisnake.h"
+
+namespace {
+
+/*
+ * Write a volume with a filament along x and a fainter one along y
+ * crossing it, so that snakes hook onto each other.
+ */
+void WriteSyntheticImage(const std::string &filename) {
+  soax::ImageType::SizeType size;
+  size[0] = 96;
+  size[1] = 96;
+  size[2] = 24;
+  soax::ImageType::RegionType region(size);
+  soax::ImageType::Pointer image = soax::ImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<soax::ImageType> it(image, region);
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+    const soax::ImageType::IndexType &index = it.GetIndex();
+    const double dy = index[1] - (48.0 + 12.0 * std::sin(index[0] / 15.0));
+    const double dx = index[0] - (40.0 + 10.0 * std::cos(index[1] / 20.0));
+    const double dz = index[2] - 12.0;
+    const double intensity = 200.0 +
+        3000.0 * std::exp(-(dy * dy + dz * dz) / 4.0) +
+        2400.0 * std::exp(-(dx * dx + dz * dz) / 4.0);
+    it.Set(static_cast<soax::ImageType::PixelType>(intensity));
+  }
+
+  typedef itk::ImageFileWriter<soax::ImageType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName(filename);
+  writer->SetInput(image);
+  writer->Update();
+}
+
+soax::Multisnake *Deform(const std::string &image_filename,
+                         soax::Multisnake::DeformationScheme scheme,
+                         unsigned num_threads) {
+  soax::Multisnake *multisnake = new soax::Multisnake;
+  multisnake->LoadImage(image_filename);
+  multisnake->ComputeImageGradient();
+  multisnake->set_number_of_threads(num_threads);
+  multisnake->InitializeSnakes();
+  multisnake->DeformSnakes(scheme);
+  return multisnake;
+}
+
+/*
+ * Return true if the snakes have the same vertices in the same order.
+ */
+bool HaveSameSnakes(const soax::SnakeContainer &expected,
+                    const soax::SnakeContainer &snakes,
+                    const std::string &name) {
+  if (snakes.size() != expected.size()) {
+    std::cerr << name << ": " << snakes.size() << " snakes instead of "
+              << expected.size() << std::endl;
+    return false;
+  }
+  for (unsigned i = 0; i < snakes.size(); ++i) {
+    if (snakes[i]->GetSize() != expected[i]->GetSize()) {
+      std::cerr << name << ": snake " << i << " has "
+                << snakes[i]->GetSize() << " vertices instead of "
+                << expected[i]->GetSize() << std::endl;
+      return false;
+    }
+    for (unsigned j = 0; j < snakes[i]->GetSize(); ++j) {
+      if (snakes[i]->GetPoint(j) != expected[i]->GetPoint(j)) {
+        std::cerr << name << ": vertex " << j << " of snake " << i
+                  << " is " << snakes[i]->GetPoint(j) << " instead of "
+                  << expected[i]->GetPoint(j) << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Return true if the speculative evolutions of the last deformation add
+ * up to its commits and retries.
+ */
+bool HaveConsistentCounts(const soax::Multisnake &multisnake,
+                          const std::string &name) {
+  if (multisnake.number_of_evolutions() ==
+      multisnake.number_of_commits() + multisnake.number_of_retries())
+    return true;
+  std::cerr << name << ": " << multisnake.number_of_evolutions()
+            << " evolutions for " << multisnake.number_of_commits()
+            << " commits and " << multisnake.number_of_retries()
+            << " retries" << std::endl;
+  return false;
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv) {
+  std::string image_filename = "deformation_test.mha";
+  if (argc > 1) {
+    image_filename = argv[1];
+  } else {
+    WriteSyntheticImage(image_filename);
+  }
+  std::cerr.precision(17);
+
+  soax::Multisnake *reference = Deform(
+      image_filename, soax::Multisnake::kDeterministicDeformation, 1);
+  const soax::SnakeContainer &expected = reference->converged_snakes();
+  if (expected.size() < 2) {
+    std::cerr << "Only " << expected.size()
+              << " converged snakes; the test needs more." << std::endl;
+    delete reference;
+    return EXIT_FAILURE;
+  }
+
+  bool passed = true;
+  const unsigned thread_counts[] = {3, 4};
+  for (unsigned i = 0; i < 2; ++i) {
+    soax::Multisnake *multisnake = Deform(
+        image_filename, soax::Multisnake::kDeterministicDeformation,
+        thread_counts[i]);
+    const std::string name = std::to_string(thread_counts[i]) + " threads";
+    passed &= HaveSameSnakes(expected, multisnake->converged_snakes(), name);
+    passed &= HaveConsistentCounts(*multisnake, name);
+    delete multisnake;
+  }
+
+  soax::Multisnake *serial = Deform(
+      image_filename, soax::Multisnake::kSerialDeformation, 1);
+  passed &= HaveSameSnakes(expected, serial->converged_snakes(), "serial");
+  delete serial;
+
+  soax::Multisnake *concurrent = Deform(
+      image_filename, soax::Multisnake::kConcurrentDeformation, 1);
+  passed &= HaveSameSnakes(expected, concurrent->converged_snakes(),
+                           "concurrent");
+  passed &= HaveConsistentCounts(*concurrent, "concurrent");
+  delete concurrent;
+  concurrent = Deform(
+      image_filename, soax::Multisnake::kConcurrentDeformation, 4);
+  passed &= HaveConsistentCounts(*concurrent, "concurrent, 4 threads");
+  if (concurrent->number_of_commits() == 0) {
+    std::cerr << "concurrent, 4 threads: nothing committed" << std::endl;
+    passed = false;
+  }
+  delete concurrent;
+
+  std::cout << expected.size() << " converged snakes compared." << std::endl;
+  delete reference;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,221 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file benchmarks the serial deformation of the initial snakes in
+ * the order by length only and in the order by length bin and location
+ * (Multisnake::set_length_bin). For each bin width, it reports the wall
+ * time of DeformSnakes, the cache references and misses counted by
+ * perf_event_open on Linux while it runs, and the snakes converged.
+ * Without an image, a synthetic volume with many curved filaments is
+ * written to length_bin_benchmark.mha and used. The widths default to
+ * 0, 10, 20 and 50 pixels.
+ *
+ * Usage: ./length_bin_benchmark [image_filename [bin_width ...]]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "../multisnake.h"
+
+namespace {
+
+/*
+ * Cache counter of the calling thread, which is the one running the
+ * serial deformation. It is not valid where the kernel does not expose
+ * the counter, e.g. on other systems or in most virtual machines.
+ */
+class CacheCounter {
+ public:
+  explicit CacheCounter(bool misses) : fd_(-1) {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = misses ? PERF_COUNT_HW_CACHE_MISSES :
+        PERF_COUNT_HW_CACHE_REFERENCES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+
+  ~CacheCounter() {
+#ifdef __linux__
+    if (fd_ >= 0) close(fd_);
+#endif
+  }
+
+  bool valid() const {return fd_ >= 0;}
+
+  void Start() {
+#ifdef __linux__
+    if (fd_ < 0) return;
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  /*
+   * Stop counting and return the count since Start.
+   */
+  uint64_t Stop() {
+    uint64_t count = 0;
+#ifdef __linux__
+    if (fd_ < 0) return 0;
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+    return count;
+  }
+
+ private:
+  int fd_;
+};
+
+/*
+ * Write a 320x320x80 volume with 60 randomly placed filaments that bend
+ * slowly, so that the initial snakes spread over much more memory than
+ * the caches hold.
+ */
+void WriteSyntheticImage(const std::string &filename) {
+  soax::ImageType::SizeType size;
+  size[0] = 320;
+  size[1] = 320;
+  size[2] = 80;
+  soax::ImageType::RegionType region(size);
+  std::vector<float> ridge(size[0] * size[1] * size[2], 0.0f);
+
+  std::mt19937 generator(2015);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (unsigned f = 0; f < 60; ++f) {
+    double p[3] = {30 + uniform(generator) * (size[0] - 60),
+                   30 + uniform(generator) * (size[1] - 60),
+                   15 + uniform(generator) * (size[2] - 30)};
+    double theta = uniform(generator) * 2 * M_PI;
+    const double phi = (uniform(generator) - 0.5) * 0.3;
+    const double bend = (uniform(generator) - 0.5) * 0.02;
+    const double amplitude = 1500 + 1500 * uniform(generator);
+    const double length = 80 + uniform(generator) * 160;
+    for (double s = 0.0; s < length; s += 0.5) {
+      theta += bend * 0.5;
+      p[0] += 0.5 * std::cos(theta) * std::cos(phi);
+      p[1] += 0.5 * std::sin(theta) * std::cos(phi);
+      p[2] += 0.5 * std::sin(phi);
+      bool inside = true;
+      for (unsigned k = 0; k < 3; ++k)
+        inside = inside && p[k] >= 5 && p[k] + 6 < size[k];
+      if (!inside) break;
+
+      for (int z = p[2] - 5; z <= p[2] + 5; ++z) {
+        for (int y = p[1] - 5; y <= p[1] + 5; ++y) {
+          for (int x = p[0] - 5; x <= p[0] + 5; ++x) {
+            const double d2 = (x - p[0]) * (x - p[0]) +
+                (y - p[1]) * (y - p[1]) + (z - p[2]) * (z - p[2]);
+            float &r = ridge[(z * size[1] + y) * size[0] + x];
+            r = std::max(r, static_cast<float>(
+                amplitude * std::exp(-d2 / 4.0)));
+          }
+        }
+      }
+    }
+  }
+
+  soax::ImageType::Pointer image = soax::ImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+  itk::ImageRegionIteratorWithIndex<soax::ImageType> it(image, region);
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+    const soax::ImageType::IndexType &index = it.GetIndex();
+    const float r =
+        ridge[(index[2] * size[1] + index[1]) * size[0] + index[0]];
+    it.Set(static_cast<soax::ImageType::PixelType>(200.0 + r));
+  }
+
+  typedef itk::ImageFileWriter<soax::ImageType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName(filename);
+  writer->SetInput(image);
+  writer->Update();
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv) {
+  std::string image_filename = "length_bin_benchmark.mha";
+  if (argc > 1) {
+    image_filename = argv[1];
+  } else {
+    WriteSyntheticImage(image_filename);
+  }
+  std::vector<double> bin_widths;
+  for (int i = 2; i < argc; ++i)
+    bin_widths.push_back(atof(argv[i]));
+  if (bin_widths.empty()) {
+    const double widths[] = {0.0, 10.0, 20.0, 50.0};
+    bin_widths.assign(widths, widths + 4);
+  }
+
+  std::vector<std::string> rows;
+  for (unsigned i = 0; i < bin_widths.size(); ++i) {
+    soax::Multisnake multisnake;
+    multisnake.LoadImage(image_filename);
+    multisnake.ComputeImageGradient();
+    multisnake.set_length_bin(bin_widths[i]);
+    multisnake.InitializeSnakes();
+    const unsigned num_initial = multisnake.GetNumberOfInitialSnakes();
+
+    CacheCounter references(false);
+    CacheCounter misses(true);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    references.Start();
+    misses.Start();
+    multisnake.DeformSnakes(soax::Multisnake::kSerialDeformation);
+    const uint64_t num_misses = misses.Stop();
+    const uint64_t num_references = references.Stop();
+    const std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+
+    std::ostringstream row;
+    row << std::setw(9) << bin_widths[i] << std::setw(9) << num_initial
+        << std::setw(11) << multisnake.GetNumberOfConvergedSnakes()
+        << std::setw(10) << std::fixed << std::setprecision(2)
+        << seconds.count();
+    if (references.valid() && misses.valid()) {
+      row << std::setw(18) << num_references << std::setw(14)
+          << num_misses;
+    } else {
+      row << std::setw(18) << "n/a" << std::setw(14) << "n/a";
+    }
+    rows.push_back(row.str());
+  }
+
+  std::cout << "\n      bin  initial  converged  time (s)"
+            << "  cache references  cache misses" << std::endl;
+  for (unsigned i = 0; i < rows.size(); ++i)
+    std::cout << rows[i] << std::endl;
+  return EXIT_SUCCESS;
+}
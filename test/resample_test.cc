@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file tests that resampling a snake gives bit-identical vertices
+ * to the original implementation, which built one (length, coordinate)
+ * table per dimension and searched it with lower_bound.
+ *
+ * Usage: ./resample_test [number_of_polylines]
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+#include "../snake.h"
+
+namespace {
+
+typedef std::vector<std::pair<double, double> > PairContainer;
+
+/*
+ * The original Snake::UpdateLength.
+ */
+double UpdateLength(const soax::PointContainer &vertices,
+                    PairContainer *sums) {
+  double current_length = 0.0;
+  for (unsigned k = 0; k < soax::kDimension; ++k) {
+    sums[k].push_back(std::make_pair(current_length, vertices.front()[k]));
+  }
+
+  for (unsigned i = 1; i < vertices.size(); ++i) {
+    current_length += vertices[i].EuclideanDistanceTo(vertices[i-1]);
+    for (unsigned k = 0; k < soax::kDimension; ++k) {
+      sums[k].push_back(std::make_pair(current_length, vertices.at(i)[k]));
+    }
+  }
+  return current_length;
+}
+
+/*
+ * The original Snake::InterpolateVertices.
+ */
+soax::PointContainer InterpolateVertices(
+    const soax::PointContainer &vertices, const PairContainer *sums,
+    double spacing, unsigned new_size) {
+  soax::PointContainer new_vertices(new_size);
+
+  new_vertices.front() = vertices.front();
+  new_vertices.back() = vertices.back();
+
+  for (unsigned i = 1; i < new_size-1; ++i) {
+    for (unsigned k = 0; k < soax::kDimension; ++k) {
+      PairContainer::const_iterator it1, it2;
+      it1 = lower_bound(sums[k].begin(), sums[k].end(),
+                        std::make_pair(spacing*i, 0.0));
+      it2 = it1--;
+      new_vertices[i][k] = it1->second + (it2->second - it1->second) *
+          (spacing*i - it1->first) / (it2->first - it1->first);
+    }
+  }
+  return new_vertices;
+}
+
+/*
+ * Return a random polyline inside a 100-pixel cube. Coordinates are
+ * positive as in an image, which the original lower_bound search relied
+ * on to break ties between equal lengths. Runs of repeated vertices
+ * give zero-length segments. On a lattice, the polyline moves by unit
+ * steps along the axes, so that with a spacing of 1 the new vertices
+ * fall exactly on old ones, next to the zero-length segments.
+ */
+soax::PointContainer GeneratePolyline(std::mt19937 &generator,
+                                      bool lattice) {
+  std::uniform_int_distribution<unsigned> size(2, 200);
+  std::uniform_int_distribution<unsigned> coordinate(10, 90);
+  std::uniform_real_distribution<double> step(-3.0, 3.0);
+  std::uniform_int_distribution<unsigned> axis(0, soax::kDimension - 1);
+  std::uniform_int_distribution<unsigned> repeat(0, 9);
+
+  soax::PointContainer points(size(generator));
+  for (unsigned k = 0; k < soax::kDimension; ++k)
+    points[0][k] = coordinate(generator);
+  for (unsigned i = 1; i < points.size(); ++i) {
+    points[i] = points[i-1];
+    if (repeat(generator) < 3) continue;
+    if (lattice) {
+      points[i][axis(generator)] += generator() % 2 ? 1.0 : -1.0;
+    } else {
+      for (unsigned k = 0; k < soax::kDimension; ++k)
+        points[i][k] += step(generator);
+    }
+  }
+  for (unsigned i = 0; i < points.size(); ++i) {
+    for (unsigned k = 0; k < soax::kDimension; ++k)
+      points[i][k] = std::max(points[i][k], 1.0);
+  }
+  return points;
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv) {
+  const unsigned number_of_polylines = argc > 1 ? atoi(argv[1]) : 20000;
+  std::cerr.precision(17);
+  std::mt19937 generator(2015);
+  std::uniform_real_distribution<double> spacing(0.5, 3.0);
+  soax::SnakeParameters parameters;
+
+  unsigned compared = 0;
+  for (unsigned n = 0; n < number_of_polylines; ++n) {
+    const bool lattice = n % 2;
+    const soax::PointContainer points = GeneratePolyline(generator, lattice);
+    parameters.set_desired_spacing(lattice ? 1.0 : spacing(generator));
+    soax::Snake snake(points, &parameters);
+    snake.Resample();
+
+    PairContainer sums[soax::kDimension];
+    const double length = UpdateLength(points, sums);
+    if (length < parameters.desired_spacing()) {
+      if (snake.viable()) {
+        std::cerr << "Polyline " << n << " of length " << length
+                  << " should not be viable." << std::endl;
+        return EXIT_FAILURE;
+      }
+      continue;
+    }
+    if (snake.length() != length) {
+      std::cerr << "Polyline " << n << ": length " << snake.length()
+                << " differs from " << length << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // The new size only depends on the length, so take it from the snake.
+    const unsigned new_size = snake.GetSize();
+    const soax::PointContainer expected = InterpolateVertices(
+        points, sums, length / (new_size - 1), new_size);
+    for (unsigned i = 0; i < new_size; ++i) {
+      for (unsigned k = 0; k < soax::kDimension; ++k) {
+        if (snake.GetPoint(i)[k] != expected[i][k]) {
+          std::cerr << "Polyline " << n << ": vertex " << i << " differs: "
+                    << snake.GetPoint(i) << " instead of " << expected[i]
+                    << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+    compared++;
+  }
+  std::cout << compared << " of " << number_of_polylines
+            << " polylines resampled identically." << std::endl;
+  return EXIT_SUCCESS;
+}
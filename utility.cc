@@ -6,9 +6,13 @@
  * This file implements utility functions for SOAX.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <thread>
+#include <vector>
 #include "./utility.h"
 
 namespace soax {
@@ -148,4 +152,53 @@ void PrintDataContainer(const DataContainer &data) {
   std::cout << "\n====================" << std::endl;
 }
 
+void ParallelFor(unsigned size,
+                 const std::function<void(unsigned, unsigned)> &body,
+                 unsigned num_threads) {
+  if (num_threads == 0)
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  num_threads = std::min(num_threads, size);
+  if (num_threads <= 1) {
+    body(0, size);
+    return;
+  }
+
+  std::vector<unsigned> bounds(num_threads + 1);
+  for (unsigned t = 0; t <= num_threads; ++t) {
+    bounds[t] = static_cast<unsigned>(
+        static_cast<unsigned long long>(size) * t / num_threads);
+  }
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < num_threads - 1; ++t)
+    threads.push_back(std::thread(body, bounds[t], bounds[t + 1]));
+  body(bounds[num_threads - 1], size);
+  for (unsigned t = 0; t < threads.size(); ++t)
+    threads[t].join();
+}
+
+void ParallelForEach(unsigned size,
+                     const std::function<void(unsigned, unsigned)> &body,
+                     unsigned num_threads) {
+  if (num_threads == 0)
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  num_threads = std::min(num_threads, size);
+  if (num_threads <= 1) {
+    for (unsigned i = 0; i < size; ++i)
+      body(i, 0);
+    return;
+  }
+
+  std::atomic<unsigned> next(0);
+  const std::function<void(unsigned)> run = [&](unsigned thread) {
+    for (unsigned i = next++; i < size; i = next++)
+      body(i, thread);
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < num_threads - 1; ++t)
+    threads.push_back(std::thread(run, t));
+  run(num_threads - 1);
+  for (unsigned t = 0; t < threads.size(); ++t)
+    threads[t].join();
+}
+
 }  // namespace soax
@@ -9,6 +9,7 @@
 #ifndef UTILITY_H_
 #define UTILITY_H_
 
+#include <functional>
 #include <string>
 #include "./global.h"
 
@@ -30,6 +31,28 @@ double Maximum(const DataContainer &data);
 std::string GetImageName(const std::string &snake_path);
 
 void PrintDataContainer(const DataContainer &data);
+
+/*
+ * Split [0, size) into contiguous ranges, one per thread, and call
+ * body(begin, end) on each range concurrently. The calling thread runs
+ * the last range. A num_threads of 0 means one thread per hardware
+ * thread.
+ */
+void ParallelFor(unsigned size,
+                 const std::function<void(unsigned, unsigned)> &body,
+                 unsigned num_threads = 0);
+
+/*
+ * Call body(i, thread) for each i in [0, size) concurrently, where
+ * thread in [0, num_threads) identifies the thread running the body;
+ * the thread calling ParallelForEach is the last one. The indices are
+ * handed out one at a time as the threads become free, which balances
+ * bodies of uneven cost. A num_threads of 0 means one thread per
+ * hardware thread.
+ */
+void ParallelForEach(unsigned size,
+                     const std::function<void(unsigned, unsigned)> &body,
+                     unsigned num_threads = 0);
 }  // namespace soax
 
 #endif  // UTILITY_H_
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file implements the vertex storage of snakes for SOAX.
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include "./vertex_buffer.h"
+
+namespace soax {
+
+const std::size_t VertexBuffer::kAlignment;
+const unsigned VertexBuffer::kMinimumCapacity;
+
+VertexBuffer::VertexBuffer() : data_(NULL), capacity_(0), begin_(0),
+                               size_(0) {}
+
+VertexBuffer::VertexBuffer(const VertexBuffer &other) :
+    data_(NULL), capacity_(0), begin_(0), size_(0) {
+  *this = other;
+}
+
+VertexBuffer &VertexBuffer::operator=(const VertexBuffer &other) {
+  if (this == &other) return *this;
+  size_ = 0;
+  this->Resize(other.size_);
+  for (unsigned k = 0; k < kDimension; ++k) {
+    std::copy(other.coordinates(k), other.coordinates(k) + other.size_,
+              this->coordinates(k));
+  }
+  return *this;
+}
+
+PointType VertexBuffer::GetPoint(unsigned i) const {
+  assert(i < size_);
+  PointType p;
+  for (unsigned k = 0; k < kDimension; ++k)
+    p[k] = this->coordinates(k)[i];
+  return p;
+}
+
+void VertexBuffer::SetPoint(unsigned i, const PointType &p) {
+  assert(i < size_);
+  for (unsigned k = 0; k < kDimension; ++k)
+    this->coordinates(k)[i] = p[k];
+}
+
+PointContainer VertexBuffer::GetPoints(unsigned start, unsigned end) const {
+  assert(start <= end && end <= size_);
+  PointContainer points(end - start);
+  for (unsigned i = start; i < end; ++i)
+    points[i - start] = this->GetPoint(i);
+  return points;
+}
+
+void VertexBuffer::Assign(const PointContainer &points) {
+  size_ = 0;
+  this->Resize(points.size());
+  for (unsigned i = 0; i < size_; ++i)
+    this->SetPoint(i, points[i]);
+}
+
+void VertexBuffer::Resize(unsigned size) {
+  if (begin_ + size > capacity_) {
+    if (size_ == 0 && size <= capacity_) {
+      // Nothing to keep, so just move the beginning to make room.
+      const unsigned doubles_per_alignment = kAlignment / sizeof(double);
+      begin_ = (capacity_ - size) / 2 / doubles_per_alignment *
+               doubles_per_alignment;
+    } else {
+      unsigned capacity = std::max(2 * size, kMinimumCapacity);
+      this->Reallocate(capacity, (capacity - size) / 2);
+    }
+  }
+  size_ = size;
+}
+
+void VertexBuffer::PushFront(const PointType &p) {
+  this->ReserveFront();
+  begin_--;
+  size_++;
+  this->SetPoint(0, p);
+}
+
+void VertexBuffer::PushBack(const PointType &p) {
+  this->ReserveBack();
+  size_++;
+  this->SetPoint(size_ - 1, p);
+}
+
+void VertexBuffer::Erase(unsigned start, unsigned end) {
+  assert(start <= end && end <= size_);
+  const unsigned n = end - start;
+  if (start < size_ - end) {
+    this->Shift(0, start, n);
+    begin_ += n;
+  } else {
+    this->Shift(end, size_, -static_cast<int>(n));
+  }
+  size_ -= n;
+}
+
+void VertexBuffer::Insert(unsigned i, const PointType &p) {
+  assert(i <= size_);
+  if (i < size_ - i) {
+    this->ReserveFront();
+    this->Shift(0, i, -1);
+    begin_--;
+  } else {
+    this->ReserveBack();
+    this->Shift(i, size_, 1);
+  }
+  size_++;
+  this->SetPoint(i, p);
+}
+
+void VertexBuffer::Swap(VertexBuffer &other) {
+  storage_.swap(other.storage_);
+  std::swap(data_, other.data_);
+  std::swap(capacity_, other.capacity_);
+  std::swap(begin_, other.begin_);
+  std::swap(size_, other.size_);
+}
+
+void VertexBuffer::Reallocate(unsigned capacity, unsigned begin) {
+  // Round the capacity up so that every coordinate array is aligned,
+  // and the beginning down so that the first vertex is aligned too.
+  const unsigned doubles_per_alignment = kAlignment / sizeof(double);
+  capacity = (capacity + doubles_per_alignment - 1) /
+             doubles_per_alignment * doubles_per_alignment;
+  begin = begin / doubles_per_alignment * doubles_per_alignment;
+
+  std::vector<double> storage(kDimension * capacity +
+                              doubles_per_alignment - 1);
+  uintptr_t address = reinterpret_cast<uintptr_t>(&storage[0]);
+  address = (address + kAlignment - 1) & ~(kAlignment - 1);
+  double *data = reinterpret_cast<double *>(address);
+
+  for (unsigned k = 0; k < kDimension; ++k) {
+    std::copy(this->coordinates(k), this->coordinates(k) + size_,
+              data + k * capacity + begin);
+  }
+  storage_.swap(storage);
+  data_ = data;
+  capacity_ = capacity;
+  begin_ = begin;
+}
+
+void VertexBuffer::ReserveFront() {
+  if (begin_ > 0) return;
+  this->Recenter();
+}
+
+void VertexBuffer::ReserveBack() {
+  if (begin_ + size_ < capacity_) return;
+  this->Recenter();
+}
+
+/*
+ * Implementation Notes: Recenter:
+ * -------------------------------
+ * A snake that keeps growing at one tip while being cut at the other
+ * runs out of room at one end with most of the arrays unused. When at
+ * most half of the capacity is used, the vertices are shifted back to
+ * the middle of the arrays, which leaves at least a quarter of the
+ * capacity free at each end. Only fuller buffers are grown.
+ */
+void VertexBuffer::Recenter() {
+  if (capacity_ >= kMinimumCapacity && 2 * size_ <= capacity_) {
+    const unsigned doubles_per_alignment = kAlignment / sizeof(double);
+    const unsigned begin = (capacity_ - size_) / 2 /
+                           doubles_per_alignment * doubles_per_alignment;
+    this->Shift(0, size_, static_cast<int>(begin) -
+                static_cast<int>(begin_));
+    begin_ = begin;
+  } else {
+    unsigned capacity = std::max(2 * capacity_, kMinimumCapacity);
+    this->Reallocate(capacity, (capacity - size_) / 2);
+  }
+}
+
+void VertexBuffer::Shift(unsigned start, unsigned end, int offset) {
+  if (start == end || offset == 0) return;
+  for (unsigned k = 0; k < kDimension; ++k) {
+    double *c = this->coordinates(k);
+    if (offset < 0)
+      std::copy(c + start, c + end, c + start + offset);
+    else
+      std::copy_backward(c + start, c + end, c + end + offset);
+  }
+}
+
+}  // namespace soax
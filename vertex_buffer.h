@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file defines the vertex storage of snakes for SOAX.
+ */
+
+
+#ifndef VERTEX_BUFFER_H_
+#define VERTEX_BUFFER_H_
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include "./global.h"
+
+namespace soax {
+
+/*
+ * Contiguous structure-of-arrays storage of snake vertices. The x, y
+ * and z coordinates are kept in three separate arrays, each starting at
+ * a kAlignment-byte boundary, so that loops over one coordinate are
+ * unit-stride and can be vectorized.
+ *
+ * The vertices occupy the middle of the arrays with free room on both
+ * sides, so that adding a vertex at either end is amortized O(1), like
+ * the std::deque it replaces. Erasing a range moves the shorter side.
+ */
+class VertexBuffer {
+ public:
+  VertexBuffer();
+  VertexBuffer(const VertexBuffer &other);
+  VertexBuffer &operator=(const VertexBuffer &other);
+
+  unsigned size() const {return size_;}
+  bool empty() const {return size_ == 0;}
+
+  /*
+   * Pointer to the k-th coordinate of the first vertex. The k-th
+   * coordinates of all vertices follow contiguously.
+   */
+  double *coordinates(unsigned k) {return data_ + k * capacity_ + begin_;}
+  const double *coordinates(unsigned k) const {
+    return data_ + k * capacity_ + begin_;
+  }
+
+  double GetCoordinate(unsigned i, unsigned k) const {
+    assert(i < size_);
+    return this->coordinates(k)[i];
+  }
+
+  PointType GetPoint(unsigned i) const;
+  void SetPoint(unsigned i, const PointType &p);
+  PointType GetHead() const {return this->GetPoint(0);}
+  PointType GetTail() const {return this->GetPoint(size_ - 1);}
+
+  /*
+   * Return a copy of the vertices in [start, end).
+   */
+  PointContainer GetPoints(unsigned start, unsigned end) const;
+
+  void Assign(const PointContainer &points);
+
+  /*
+   * Change the number of vertices. New vertices are uninitialized. The
+   * storage is reused if it is large enough, so a cleared buffer can be
+   * refilled without allocation.
+   */
+  void Resize(unsigned size);
+  void Clear() {size_ = 0;}
+
+  void PushFront(const PointType &p);
+  void PushBack(const PointType &p);
+
+  /*
+   * Remove the vertices in [start, end).
+   */
+  void Erase(unsigned start, unsigned end);
+
+  /*
+   * Insert p before the i-th vertex.
+   */
+  void Insert(unsigned i, const PointType &p);
+
+  void Swap(VertexBuffer &other);
+
+  static const std::size_t kAlignment = 32;
+
+ private:
+  /*
+   * Move the vertices to new arrays of at least the given capacity,
+   * with the first vertex at the aligned position at or before begin.
+   */
+  void Reallocate(unsigned capacity, unsigned begin);
+
+  /*
+   * Make room for one more vertex at the front or at the back.
+   */
+  void ReserveFront();
+  void ReserveBack();
+
+  /*
+   * Move the vertices to the middle of the arrays, growing them if they
+   * are more than half full.
+   */
+  void Recenter();
+
+  /*
+   * Move the vertices in [start, end) by offset positions in all the
+   * coordinate arrays.
+   */
+  void Shift(unsigned start, unsigned end, int offset);
+
+  static const unsigned kMinimumCapacity = 16;
+
+  std::vector<double> storage_;
+
+  /*
+   * Aligned start of the x array within storage_. The y and z arrays
+   * follow at strides of capacity_.
+   */
+  double *data_;
+  unsigned capacity_;
+  unsigned begin_;
+  unsigned size_;
+};
+
+}  // namespace soax
+
+#endif  // VERTEX_BUFFER_H_
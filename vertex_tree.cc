@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file implements the k-d tree of snake vertices for SOAX.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "./vertex_tree.h"
+#include "./snake.h"
+
+namespace soax {
+
+namespace {
+
+/*
+ * Orders vertices by one coordinate.
+ */
+template <typename VertexType>
+struct CoordinateLess {
+  explicit CoordinateLess(unsigned a) : axis(a) {}
+  bool operator()(const VertexType &v1, const VertexType &v2) const {
+    return v1.x[axis] < v2.x[axis];
+  }
+  unsigned axis;
+};
+
+}  // namespace
+
+VertexTree::VertexTree(const SnakeContainer &snakes) {
+  for (SnakeConstIterator it = snakes.begin(); it != snakes.end(); ++it) {
+    for (unsigned i = 0; i < (*it)->GetSize(); ++i) {
+      Vertex v;
+      for (unsigned k = 0; k < kDimension; ++k)
+        v.x[k] = (*it)->GetPoint(i)[k];
+      vertices_.push_back(v);
+    }
+  }
+  axes_.resize(vertices_.size());
+  this->Build(0, vertices_.size());
+}
+
+double VertexTree::ComputeShortestDistance(const PointType &p) const {
+  double min_d = kPlusInfinity;
+  this->Search(p, 0, vertices_.size(), min_d);
+  return vertices_.empty() ? kPlusInfinity : std::sqrt(min_d);
+}
+
+void VertexTree::Build(unsigned begin, unsigned end) {
+  if (end - begin < 2) return;
+
+  double low[kDimension], high[kDimension];
+  for (unsigned k = 0; k < kDimension; ++k)
+    low[k] = high[k] = vertices_[begin].x[k];
+  for (unsigned i = begin + 1; i < end; ++i) {
+    for (unsigned k = 0; k < kDimension; ++k) {
+      low[k] = std::min(low[k], vertices_[i].x[k]);
+      high[k] = std::max(high[k], vertices_[i].x[k]);
+    }
+  }
+  unsigned axis = 0;
+  for (unsigned k = 1; k < kDimension; ++k) {
+    if (high[k] - low[k] > high[axis] - low[axis])
+      axis = k;
+  }
+
+  const unsigned middle = begin + (end - begin) / 2;
+  std::nth_element(vertices_.begin() + begin, vertices_.begin() + middle,
+                   vertices_.begin() + end, CoordinateLess<Vertex>(axis));
+  axes_[middle] = axis;
+  this->Build(begin, middle);
+  this->Build(middle + 1, end);
+}
+
+void VertexTree::Search(const PointType &p, unsigned begin, unsigned end,
+                        double &min_d) const {
+  if (begin >= end) return;
+
+  const unsigned middle = begin + (end - begin) / 2;
+  const Vertex &v = vertices_[middle];
+  const double dx = p[0] - v.x[0];
+  const double dy = p[1] - v.x[1];
+  const double dz = p[2] - v.x[2];
+  min_d = std::min(min_d, dx * dx + dy * dy + dz * dz);
+  if (end - begin == 1) return;
+
+  // Search the side of p first; the other side can only hold a closer
+  // vertex if the splitting plane is closer than the best so far.
+  const double offset = p[axes_[middle]] - v.x[axes_[middle]];
+  if (offset < 0) {
+    this->Search(p, begin, middle, min_d);
+    if (offset * offset < min_d)
+      this->Search(p, middle + 1, end, min_d);
+  } else {
+    this->Search(p, middle + 1, end, min_d);
+    if (offset * offset < min_d)
+      this->Search(p, begin, middle, min_d);
+  }
+}
+
+}  // namespace soax
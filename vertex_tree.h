@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2015, Lehigh University
+ * All rights reserved.
+ * See COPYING for license.
+ *
+ * This file defines the k-d tree of snake vertices for SOAX.
+ */
+
+
+#ifndef VERTEX_TREE_H_
+#define VERTEX_TREE_H_
+
+#include <vector>
+#include "./global.h"
+
+namespace soax {
+
+/*
+ * A static k-d tree over the vertices of a set of snakes. It answers
+ * nearest-vertex distance queries in O(log n) expected time however far
+ * the query point is from the snakes, which makes it suited to comparing
+ * two fixed snake sets. Use SnakeIndex for sets that grow and for
+ * queries within a known radius.
+ *
+ * The tree is implicit: each range of vertices is split at its median
+ * along the axis of its largest extent, and the median is stored in the
+ * middle of the range. Queries only read the tree, so they can run
+ * concurrently.
+ */
+class VertexTree {
+ public:
+  explicit VertexTree(const SnakeContainer &snakes);
+
+  unsigned size() const {return vertices_.size();}
+
+  /*
+   * Return the distance from p to the closest vertex, or kPlusInfinity
+   * if the tree is empty.
+   */
+  double ComputeShortestDistance(const PointType &p) const;
+
+ private:
+  struct Vertex {
+    double x[kDimension];
+  };
+
+  void Build(unsigned begin, unsigned end);
+
+  /*
+   * Search [begin, end) for a vertex closer to p than the squared
+   * distance min_d, and update min_d.
+   */
+  void Search(const PointType &p, unsigned begin, unsigned end,
+              double &min_d) const;
+
+  std::vector<Vertex> vertices_;
+
+  /*
+   * Split axis of the range whose median is at each position.
+   */
+  std::vector<unsigned char> axes_;
+
+  DISALLOW_COPY_AND_ASSIGN(VertexTree);
+};
+
+}  // namespace soax
+
+#endif  // VERTEX_TREE_H_